@@ -0,0 +1,207 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#include "BenchUtil.h"
+#include <QDir>
+#include <QFile>
+#include <QGVLayoutCache.h>
+#include <cgraph.h>
+#include <cstring>
+#include <random>
+
+namespace
+{
+QByteArray quoted(const QByteArray &text)
+{
+    QByteArray escaped = text;
+    escaped.replace('"', "\\\"");
+    return '"' + escaped + '"';
+}
+
+QByteArray value(char *text)
+{
+    return aghtmlstr(text) ? '<' + QByteArray(text) + '>' : quoted(text);
+}
+
+// Attributes of the object that differ from their declared default
+QByteArray attributes(Agraph_t *root, void *object, int kind)
+{
+    QByteArray result;
+
+    for (Agsym_t *sym = agnxtattr(root, kind, NULL); sym; sym = agnxtattr(root, kind, sym))
+    {
+        char *text = agxget(object, sym);
+
+        if (std::strcmp(text, sym->defval) == 0)
+            continue;
+
+        if (!result.isEmpty())
+            result += ", ";
+        result += quoted(sym->name) + '=' + value(text);
+    }
+
+    return result;
+}
+
+// Declared defaults, written once at the top of the output
+QByteArray defaults(Agraph_t *root, int kind)
+{
+    QByteArray result;
+
+    for (Agsym_t *sym = agnxtattr(root, kind, NULL); sym; sym = agnxtattr(root, kind, sym))
+    {
+        if (!result.isEmpty())
+            result += ", ";
+        result += quoted(sym->name) + '=' + value(sym->defval);
+    }
+
+    return result;
+}
+
+void write_subgraphs(Agraph_t *root, Agraph_t *graph, const QByteArray &suffix, QByteArray &out)
+{
+    for (auto sg = agfstsubg(graph); sg; sg = agnxtsubg(sg))
+    {
+        // Keep the name prefix, "cluster" subgraphs are drawn as boxes.
+        out += "subgraph " + quoted(QByteArray(agnameof(sg)) + suffix) + " {\n";
+
+        const QByteArray attrs = attributes(root, sg, AGRAPH);
+        if (!attrs.isEmpty())
+            out += "graph [" + attrs + "]\n";
+
+        for (auto node = agfstnode(sg); node; node = agnxtnode(sg, node))
+            out += quoted(QByteArray(agnameof(node)) + suffix) + '\n';
+
+        write_subgraphs(root, sg, suffix, out);
+        out += "}\n";
+    }
+}
+}
+
+QString BenchUtil::sampleFile(const QString &name)
+{
+    return QDir(QStringLiteral(QGV_SAMPLE_DIR)).filePath(name);
+}
+
+QByteArray BenchUtil::replicatedDot(const QString &path, int copies)
+{
+    QFile file(path);
+
+    if (!file.open(QIODevice::ReadOnly))
+        qFatal("Could not open %s", qPrintable(path));
+
+    const QByteArray source = file.readAll();
+    Agraph_t *graph = agmemread(source.constData());
+
+    if (!graph)
+        qFatal("Could not parse %s", qPrintable(path));
+
+    const QByteArray arrow = agisdirected(graph) ? " -> " : " -- ";
+    QByteArray out;
+
+    out += QByteArray(agisstrict(graph) ? "strict " : "") + (agisdirected(graph) ? "digraph" : "graph") + " {\n";
+
+    for (int kind: { AGRAPH, AGNODE, AGEDGE })
+    {
+        const QByteArray decls = defaults(graph, kind);
+        if (!decls.isEmpty())
+            out += QByteArray(kind == AGRAPH ? "graph" : kind == AGNODE ? "node" : "edge") + " [" + decls + "]\n";
+    }
+
+    for (int copy = 0; copy < copies; copy++)
+    {
+        const QByteArray suffix = '_' + QByteArray::number(copy);
+
+        for (auto node = agfstnode(graph); node; node = agnxtnode(graph, node))
+        {
+            out += quoted(QByteArray(agnameof(node)) + suffix);
+
+            const QByteArray attrs = attributes(graph, node, AGNODE);
+            if (!attrs.isEmpty())
+                out += " [" + attrs + ']';
+            out += '\n';
+        }
+
+        for (auto node = agfstnode(graph); node; node = agnxtnode(graph, node))
+        {
+            for (auto edge = agfstout(graph, node); edge; edge = agnxtout(graph, edge))
+            {
+                out += quoted(QByteArray(agnameof(node)) + suffix) + arrow +
+                       quoted(QByteArray(agnameof(aghead(edge))) + suffix);
+
+                const QByteArray attrs = attributes(graph, edge, AGEDGE);
+                if (!attrs.isEmpty())
+                    out += " [" + attrs + ']';
+                out += '\n';
+            }
+        }
+
+        write_subgraphs(graph, graph, suffix, out);
+    }
+
+    out += "}\n";
+    agclose(graph);
+    return out;
+}
+
+QByteArray BenchUtil::generatedDot(int elements)
+{
+    const int nodes = qMax(1, elements / 3);
+    const int edges = elements - nodes;
+    std::mt19937 random(1);
+    // Short forward edges keep the graph layered like the sample graphs.
+    std::uniform_int_distribution<int> span(1, 64);
+
+    QByteArray out = "digraph {\nnode [shape=box]\n";
+
+    for (int i = 0; i < nodes; i++)
+        out += "n" + QByteArray::number(i) + " [label=\"Node " + QByteArray::number(i) + "\"]\n";
+
+    for (int i = 0; i < edges; i++)
+    {
+        const int tail = i % nodes;
+        const int head = (tail + span(random)) % nodes;
+        out += "n" + QByteArray::number(tail) + " -> n" + QByteArray::number(head) + '\n';
+    }
+
+    out += "}\n";
+    return out;
+}
+
+void BenchUtil::generatedSizes(benchmark::internal::Benchmark *benchmark)
+{
+    const int maxElements = envInt("QGV_BENCH_MAX_ELEMENTS", 200000);
+
+    for (int elements: { 1000, 10000, 50000, 200000 })
+    {
+        if (elements <= maxElements)
+            benchmark->Arg(elements);
+    }
+}
+
+QGVLayoutCache *BenchUtil::layoutCache()
+{
+    static QGVLayoutCache cache(64);
+    return &cache;
+}
+
+int BenchUtil::envInt(const char *name, int defaultValue)
+{
+    bool ok = false;
+    const int result = qEnvironmentVariableIntValue(name, &ok);
+    return ok ? result : defaultValue;
+}
@@ -0,0 +1,53 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#ifndef BENCHUTIL_H
+#define BENCHUTIL_H
+
+#include <QByteArray>
+#include <QString>
+#include <benchmark/benchmark.h>
+
+class QGVLayoutCache;
+
+namespace BenchUtil
+{
+// Path of a file in the Sample directory of the source tree
+QString sampleFile(const QString &name);
+
+// DOT text of `copies` disjoint copies of the graph in the file, object names
+// suffixed with the copy number. Attributes, subgraphs and HTML labels are
+// preserved.
+QByteArray replicatedDot(const QString &path, int copies);
+
+// DOT text of a random, mostly forward pointing digraph with about elements
+// nodes plus edges, a third of them nodes. The same for each call.
+QByteArray generatedDot(int elements);
+
+// Sizes of the generated graphs, 1k to QGV_BENCH_MAX_ELEMENTS (200k by
+// default), as benchmark arguments.
+void generatedSizes(benchmark::internal::Benchmark *benchmark);
+
+// Layouts shared by the benchmarks that are not about computing them, so
+// each generated graph is only laid out once per run.
+QGVLayoutCache *layoutCache();
+
+// Integer from the environment, for quicker runs on smaller inputs
+int envInt(const char *name, int defaultValue);
+}
+
+#endif // BENCHUTIL_H
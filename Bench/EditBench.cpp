@@ -0,0 +1,65 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#include <QGVEdge.h>
+#include <QGVNode.h>
+#include <QGVScene.h>
+#include <benchmark/benchmark.h>
+
+// Building and tearing down a chain of nodes through the item API, with and
+// without the beginUpdate()/endUpdate() batching.
+static void BM_AddDeleteChurn(benchmark::State &state)
+{
+    const bool batched = state.range(0);
+    const int count = state.range(1);
+    QGVScene scene;
+    QList<QGraphicsItem *> items;
+    items.reserve(2 * count);
+
+    for (auto _: state)
+    {
+        if (batched)
+            scene.beginUpdate(count, count);
+
+        QGVNode *previous = nullptr;
+
+        for (int i = 0; i < count; i++)
+        {
+            QGVNode *node = scene.addNode(QStringLiteral("Node"));
+            items.append(node);
+
+            if (previous)
+                items.append(scene.addEdge(previous, node));
+            previous = node;
+        }
+
+        if (batched)
+            scene.endUpdate();
+
+        scene.deleteItems(items);
+        items.clear();
+    }
+
+    const auto stats = scene.allocatorStats();
+    state.counters["slabAllocations"] = stats.slabAllocations;
+    state.counters["reusedSlots"] = stats.reusedSlots;
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_AddDeleteChurn)
+    ->ArgNames({ "batched", "nodes" })
+    ->ArgsProduct({ { 0, 1 }, { 1000, 10000 } })
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,118 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#include "BenchUtil.h"
+#include <QFile>
+#include <QGVGvcPrivate.h>
+#include <QGVLayoutData.h>
+#include <QGVScene.h>
+#include <QMutexLocker>
+#include <benchmark/benchmark.h>
+
+// Layout: the Graphviz engines, the conversion of their output into scene
+// geometry and applying that geometry to the items.
+
+static void BM_ApplyLayout(benchmark::State &state)
+{
+    const auto engine = QGVScene::LayoutEngine(state.range(0));
+    QFile file(BenchUtil::sampleFile("bar.dot"));
+    file.open(QIODevice::ReadOnly);
+
+    QGVScene scene;
+    scene.setLayoutEngine(engine);
+    scene.loadLayout(QString::fromUtf8(file.readAll()));
+
+    for (auto _: state)
+        scene.applyLayout();
+
+    state.SetLabel(QGVScene::layoutEngineName(engine).toStdString());
+}
+BENCHMARK(BM_ApplyLayout)
+    ->ArgName("engine")
+    ->DenseRange(QGVScene::DotEngine, QGVScene::CircoEngine)
+    ->Unit(benchmark::kMillisecond);
+
+static void convert_sizes(benchmark::internal::Benchmark *benchmark)
+{
+    // The graph is laid out by the engine once, keep that bounded.
+    const int maxElements = qMin(50000, BenchUtil::envInt("QGV_BENCH_MAX_ELEMENTS", 200000));
+
+    for (int elements: { 1000, 10000, 50000 })
+    {
+        if (elements <= maxElements)
+            benchmark->Arg(elements);
+    }
+}
+
+// Graphviz layout records to QGVLayoutData, the parallel part of
+// QGVScene::updateLayout().
+static void BM_ConvertLayout(benchmark::State &state)
+{
+    const QByteArray dot = BenchUtil::generatedDot(state.range(0));
+    // Same choice as QGVScene::AutoEngine
+    const char *engine = state.range(0) > 5000 ? "sfdp" : "dot";
+
+    QMutexLocker locker(&QGVGvcPrivate::mutex());
+    GVC_t *context = QGVGvcPrivate::acquireContext();
+    Agraph_t *graph = agmemread(dot.constData());
+
+    if (!graph || gvLayout(context, graph, engine) != 0)
+    {
+        state.SkipWithError("layout failed");
+        if (graph)
+            agclose(graph);
+        QGVGvcPrivate::releaseContext();
+        return;
+    }
+
+    for (auto _: state)
+    {
+        const QGVLayoutData layout = QGVLayoutData::fromGraph(graph);
+        benchmark::DoNotOptimize(layout.edges.constData());
+    }
+
+    gvFreeLayout(context, graph);
+    agclose(graph);
+    QGVGvcPrivate::releaseContext();
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetLabel(engine);
+}
+BENCHMARK(BM_ConvertLayout)
+    ->ArgName("elements")
+    ->Apply(convert_sizes)
+    ->Unit(benchmark::kMillisecond);
+
+// Applying a cached layout to the items, the GUI thread part of a layout.
+// Includes writing the DOT text and hashing it for the cache key, see
+// BM_ToDot for that part.
+static void BM_ApplyCachedLayout(benchmark::State &state)
+{
+    QGVScene scene;
+    scene.setLayoutEngine(QGVScene::AutoEngine);
+    scene.setLayoutCache(BenchUtil::layoutCache());
+    scene.loadLayout(QString::fromUtf8(BenchUtil::generatedDot(state.range(0))));
+
+    for (auto _: state)
+        scene.applyLayout();
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ApplyCachedLayout)
+    ->ArgName("elements")
+    ->Apply(BenchUtil::generatedSizes)
+    ->Unit(benchmark::kMillisecond);
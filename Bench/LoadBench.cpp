@@ -0,0 +1,105 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#include "BenchUtil.h"
+#include <QFile>
+#include <QGVScene.h>
+#include <benchmark/benchmark.h>
+
+// Loading DOT text: parsing, item creation and layout. The generated graphs
+// take their layout from the shared cache to keep the layout engine out of
+// the measurement, see LayoutBench.cpp for that.
+
+static void BM_LoadSample(benchmark::State &state, const char *name)
+{
+    QFile file(BenchUtil::sampleFile(name));
+    file.open(QIODevice::ReadOnly);
+    const QString dot = QString::fromUtf8(file.readAll());
+    QGVScene scene;
+
+    for (auto _: state)
+        scene.loadLayout(dot);
+
+    state.counters["items"] = scene.items().size();
+}
+BENCHMARK_CAPTURE(BM_LoadSample, foo, "foo.dot")->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_LoadSample, bar, "bar.dot")->Unit(benchmark::kMillisecond);
+
+static void BM_LoadGenerated(benchmark::State &state)
+{
+    const QString dot = QString::fromUtf8(BenchUtil::generatedDot(state.range(0)));
+    QGVScene scene;
+    scene.setLayoutEngine(QGVScene::AutoEngine);
+    scene.setLayoutCache(BenchUtil::layoutCache());
+    // Computes the layout
+    scene.loadLayout(dot);
+
+    for (auto _: state)
+        scene.loadLayout(dot);
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_LoadGenerated)
+    ->ArgName("elements")
+    ->Apply(BenchUtil::generatedSizes)
+    ->Unit(benchmark::kMillisecond);
+
+// Reloading an unchanged graph, replacing or reusing its items
+static void BM_ReloadGenerated(benchmark::State &state, QGVScene::LoadMode mode)
+{
+    const QString dot = QString::fromUtf8(BenchUtil::generatedDot(state.range(0)));
+    QGVScene scene;
+    scene.setLayoutEngine(QGVScene::AutoEngine);
+    scene.setLayoutCache(BenchUtil::layoutCache());
+    scene.setLoadMode(mode);
+    scene.loadLayout(dot);
+
+    for (auto _: state)
+        scene.loadLayout(dot);
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_CAPTURE(BM_ReloadGenerated, replace, QGVScene::ReplaceItems)
+    ->ArgName("elements")
+    ->Apply(BenchUtil::generatedSizes)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_ReloadGenerated, reuse, QGVScene::ReuseItems)
+    ->ArgName("elements")
+    ->Apply(BenchUtil::generatedSizes)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_ToDot(benchmark::State &state)
+{
+    QGVScene scene;
+    scene.setLayoutEngine(QGVScene::AutoEngine);
+    scene.setLayoutCache(BenchUtil::layoutCache());
+    scene.loadLayout(QString::fromUtf8(BenchUtil::generatedDot(state.range(0))));
+    qint64 bytes = 0;
+
+    for (auto _: state)
+    {
+        const QByteArray dot = scene.toDotBytes();
+        bytes += dot.size();
+        benchmark::DoNotOptimize(dot.constData());
+    }
+
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_ToDot)
+    ->ArgName("elements")
+    ->Apply(BenchUtil::generatedSizes)
+    ->Unit(benchmark::kMillisecond);
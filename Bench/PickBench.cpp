@@ -0,0 +1,190 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#include "BenchUtil.h"
+#include <QGVEdge.h>
+#include <QGVScene.h>
+#include <QPair>
+#include <QVector>
+#include <benchmark/benchmark.h>
+#include <random>
+
+// Pick latency of QGVScene::graphItemsAt() and graphItemsIn() on
+// Sample/bar.dot replicated QGV_BENCH_PICK_COPIES times (100 by default).
+// The benchmark argument is the QGVScene::ItemIndex.
+
+namespace
+{
+QGVScene *pick_scene()
+{
+    static QGVScene *scene = [] ()
+    {
+        auto result = new QGVScene;
+        // Bounded dot iterations, the copies lay out in minutes otherwise
+        result->setLayoutEngine(QGVScene::AutoEngine);
+        result->setAutoLayoutPolicy(0, QGVScene::DotEngine);
+
+        const int copies = BenchUtil::envInt("QGV_BENCH_PICK_COPIES", 100);
+        result->loadLayout(QString::fromUtf8(BenchUtil::replicatedDot(BenchUtil::sampleFile("bar.dot"), copies)));
+        return result;
+    }();
+
+    return scene;
+}
+
+// Uniform points over the scene plus points on the hit shapes of edges, the
+// case the edge bounding rectangles are worst at.
+QVector<QPointF> pick_points(QGVScene *scene, int count)
+{
+    std::mt19937 random(42);
+    const QRectF rect = scene->sceneRect();
+    std::uniform_real_distribution<qreal> x(rect.left(), rect.right());
+    std::uniform_real_distribution<qreal> y(rect.top(), rect.bottom());
+    std::uniform_real_distribution<qreal> percent(0.0, 1.0);
+
+    QVector<QGVEdge *> edges;
+    for (auto item: scene->items())
+    {
+        if (item->type() == QGVEdge::Type)
+            edges.append(static_cast<QGVEdge *>(item));
+    }
+
+    QVector<QPointF> result;
+    result.reserve(count);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (i % 2 && !edges.isEmpty())
+        {
+            auto edge = edges[random() % edges.size()];
+            result.append(edge->mapToScene(edge->shape().pointAtPercent(percent(random))));
+        }
+        else
+        {
+            result.append(QPointF(x(random), y(random)));
+        }
+    }
+
+    return result;
+}
+}
+
+static void BM_PickAt(benchmark::State &state)
+{
+    QGVScene *scene = pick_scene();
+    scene->setItemIndex(QGVScene::ItemIndex(state.range(0)));
+
+    const auto points = pick_points(scene, 1024);
+    // Builds the index outside of the timed loop
+    scene->graphItemsAt(points.first());
+
+    int i = 0;
+    qint64 hits = 0;
+
+    for (auto _: state)
+    {
+        const auto items = scene->graphItemsAt(points[i++ % points.size()]);
+        hits += items.size();
+        benchmark::DoNotOptimize(items);
+    }
+
+    state.counters["items"] = scene->items().size();
+    state.counters["hits"] = benchmark::Counter(hits, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_PickAt)
+    ->ArgName("index")
+    ->Arg(QGVScene::QtItemIndex)
+    ->Arg(QGVScene::RTreeItemIndex)
+    ->Unit(benchmark::kMicrosecond);
+
+static void BM_PickIn(benchmark::State &state)
+{
+    QGVScene *scene = pick_scene();
+    scene->setItemIndex(QGVScene::ItemIndex(state.range(0)));
+
+    const auto points = pick_points(scene, 1024);
+    const QSizeF size(200, 200);
+    scene->graphItemsIn(QRectF(points.first(), size));
+
+    int i = 0;
+    qint64 hits = 0;
+
+    for (auto _: state)
+    {
+        const auto items = scene->graphItemsIn(QRectF(points[i++ % points.size()], size));
+        hits += items.size();
+        benchmark::DoNotOptimize(items);
+    }
+
+    state.counters["hits"] = benchmark::Counter(hits, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_PickIn)
+    ->ArgName("index")
+    ->Arg(QGVScene::QtItemIndex)
+    ->Arg(QGVScene::RTreeItemIndex)
+    ->Unit(benchmark::kMicrosecond);
+
+// Cost of the bulk rebuild done after each layout
+static void BM_ItemIndexBuild(benchmark::State &state)
+{
+    QGVScene *scene = pick_scene();
+    const QPointF origin = scene->sceneRect().topLeft();
+
+    for (auto _: state)
+    {
+        scene->setItemIndex(QGVScene::RTreeItemIndex);
+        benchmark::DoNotOptimize(scene->graphItemsAt(origin));
+    }
+}
+BENCHMARK(BM_ItemIndexBuild)->Unit(benchmark::kMillisecond);
+
+// Name lookups of edges, QGVScene::findEdge(), on the generated graphs
+static void BM_FindEdge(benchmark::State &state)
+{
+    QGVScene scene;
+    scene.setLayoutEngine(QGVScene::AutoEngine);
+    scene.setLayoutCache(BenchUtil::layoutCache());
+    const QByteArray dot = BenchUtil::generatedDot(state.range(0));
+    scene.loadLayout(QString::fromUtf8(dot));
+
+    // The "tail -> head" lines of the DOT text
+    QVector<QPair<QString, QString>> pairs;
+    for (const QByteArray &line: dot.split('\n'))
+    {
+        const int arrow = line.indexOf(" -> ");
+        if (arrow > 0)
+            pairs.append({ QString::fromUtf8(line.left(arrow)), QString::fromUtf8(line.mid(arrow + 4)) });
+    }
+
+    int i = 0;
+    qint64 found = 0;
+
+    for (auto _: state)
+    {
+        const auto &pair = pairs[i++ % pairs.size()];
+        auto edge = scene.findEdge(pair.first, pair.second);
+        found += edge != nullptr;
+        benchmark::DoNotOptimize(edge);
+    }
+
+    // 1 unless lookups fail
+    state.counters["found"] = benchmark::Counter(found, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_FindEdge)
+    ->ArgName("elements")
+    ->Apply(BenchUtil::generatedSizes)
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,75 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#include "BenchUtil.h"
+#include <QFile>
+#include <QGVScene.h>
+#include <QImage>
+#include <QPainter>
+#include <benchmark/benchmark.h>
+
+// Full scene QGraphicsScene::render() into an image of at most 2048 pixels
+// per side, per item and in bulk rendering mode.
+
+namespace
+{
+void render_scene(benchmark::State &state, QGVScene &scene)
+{
+    scene.setBulkRendering(state.range(0));
+
+    const QRectF source = scene.sceneRect();
+    const QSize size = source.size().toSize().scaled(2048, 2048, Qt::KeepAspectRatio);
+    QImage image(size.expandedTo(QSize(1, 1)), QImage::Format_ARGB32_Premultiplied);
+
+    for (auto _: state)
+    {
+        image.fill(Qt::white);
+        QPainter painter(&image);
+        painter.setRenderHint(QPainter::Antialiasing);
+        scene.render(&painter, QRectF(image.rect()), source);
+    }
+
+    state.counters["scale"] = size.width() / qMax(1.0, source.width());
+}
+}
+
+static void BM_RenderSample(benchmark::State &state)
+{
+    QFile file(BenchUtil::sampleFile("bar.dot"));
+    file.open(QIODevice::ReadOnly);
+    QGVScene scene;
+    scene.loadLayout(QString::fromUtf8(file.readAll()));
+    render_scene(state, scene);
+}
+BENCHMARK(BM_RenderSample)
+    ->ArgName("bulk")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_RenderGenerated(benchmark::State &state)
+{
+    QGVScene scene;
+    scene.setLayoutEngine(QGVScene::AutoEngine);
+    scene.setLayoutCache(BenchUtil::layoutCache());
+    scene.loadLayout(QString::fromUtf8(BenchUtil::generatedDot(state.range(1))));
+    render_scene(state, scene);
+}
+BENCHMARK(BM_RenderGenerated)
+    ->ArgNames({ "bulk", "elements" })
+    ->ArgsProduct({ { 0, 1 }, { 10000, 50000 } })
+    ->Unit(benchmark::kMillisecond);
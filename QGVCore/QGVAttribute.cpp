@@ -0,0 +1,92 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#include "QGVAttribute.h"
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+
+namespace
+{
+struct KeyRegistry
+{
+    KeyRegistry()
+    {
+        // Same order as QGVAttributeKey::Predefined
+        for (auto name: { "label", "color", "fillcolor", "style", "shape", "tooltip", "labelfontcolor",
+                          "fontcolor", "fontname", "fontsize", "penwidth", "width", "height" })
+            intern(name);
+    }
+
+    int intern(const QByteArray &name)
+    {
+        auto it = ids.constFind(name);
+
+        if (it != ids.constEnd())
+            return it.value();
+
+        const int id = names.size();
+        names.append(name);
+        ids.insert(name, id);
+        return id;
+    }
+
+    QMutex mutex;
+    QHash<QByteArray, int> ids;
+    QVector<QByteArray> names;
+};
+
+KeyRegistry &registry()
+{
+    static KeyRegistry registry;
+    return registry;
+}
+}
+
+const QGVAttributeKey QGVAttributeKey::Label(LabelId);
+const QGVAttributeKey QGVAttributeKey::Color(ColorId);
+const QGVAttributeKey QGVAttributeKey::FillColor(FillColorId);
+const QGVAttributeKey QGVAttributeKey::Style(StyleId);
+const QGVAttributeKey QGVAttributeKey::Shape(ShapeId);
+const QGVAttributeKey QGVAttributeKey::Tooltip(TooltipId);
+const QGVAttributeKey QGVAttributeKey::LabelFontColor(LabelFontColorId);
+const QGVAttributeKey QGVAttributeKey::FontColor(FontColorId);
+const QGVAttributeKey QGVAttributeKey::FontName(FontNameId);
+const QGVAttributeKey QGVAttributeKey::FontSize(FontSizeId);
+const QGVAttributeKey QGVAttributeKey::PenWidth(PenWidthId);
+const QGVAttributeKey QGVAttributeKey::Width(WidthId);
+const QGVAttributeKey QGVAttributeKey::Height(HeightId);
+
+QGVAttributeKey::QGVAttributeKey(const QByteArray &name)
+{
+    auto &r = registry();
+    QMutexLocker locker(&r.mutex);
+    _id = r.intern(name);
+}
+
+QGVAttributeKey::QGVAttributeKey(const char *name)
+    : QGVAttributeKey(QByteArray(name))
+{
+}
+
+QByteArray QGVAttributeKey::name() const
+{
+    auto &r = registry();
+    QMutexLocker locker(&r.mutex);
+    return r.names.value(_id);
+}
@@ -0,0 +1,96 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#ifndef QGVATTRIBUTE_H
+#define QGVATTRIBUTE_H
+
+#include "qgv_export.h"
+#include <QByteArray>
+
+/**
+ * @brief Interned graphviz attribute name
+ *
+ * Keys are interned once in a process wide registry. The items resolve them
+ * to cgraph attribute symbols which are cached by the scene, so getting or
+ * setting an attribute through a key skips the by-name lookup and the
+ * conversion of the name.
+ */
+class QGVCORE_EXPORT QGVAttributeKey
+{
+public:
+    explicit QGVAttributeKey(const QByteArray &name);
+    explicit QGVAttributeKey(const char *name);
+
+    QByteArray name() const;
+
+    int id() const
+    {
+        return _id;
+    }
+
+    bool operator==(const QGVAttributeKey &other) const
+    {
+        return _id == other._id;
+    }
+
+    bool operator!=(const QGVAttributeKey &other) const
+    {
+        return _id != other._id;
+    }
+
+    static const QGVAttributeKey Label;
+    static const QGVAttributeKey Color;
+    static const QGVAttributeKey FillColor;
+    static const QGVAttributeKey Style;
+    static const QGVAttributeKey Shape;
+    static const QGVAttributeKey Tooltip;
+    static const QGVAttributeKey LabelFontColor;
+    static const QGVAttributeKey FontColor;
+    static const QGVAttributeKey FontName;
+    static const QGVAttributeKey FontSize;
+    static const QGVAttributeKey PenWidth;
+    static const QGVAttributeKey Width;
+    static const QGVAttributeKey Height;
+
+private:
+    // Ids of the predefined keys, registered in this order.
+    enum Predefined
+    {
+        LabelId,
+        ColorId,
+        FillColorId,
+        StyleId,
+        ShapeId,
+        TooltipId,
+        LabelFontColorId,
+        FontColorId,
+        FontNameId,
+        FontSizeId,
+        PenWidthId,
+        WidthId,
+        HeightId
+    };
+
+    explicit QGVAttributeKey(Predefined id)
+        : _id(id)
+    {
+    }
+
+    int _id;
+};
+
+#endif // QGVATTRIBUTE_H
@@ -20,9 +20,12 @@ License along with this library.
 #include <QGVScene.h>
 #include <QGVGraphPrivate.h>
 #include <QGVEdgePrivate.h>
+#include <QGVPrivatePools.h>
+#include <QGVLabelItem.h>
+#include <QGVLayoutData.h>
 #include <QDebug>
 #include <QPainter>
-#include <QTextDocument>
+#include <QStyleOptionGraphicsItem>
 
 QGVEdge::QGVEdge(QGVEdgePrivate *edge, QGVScene *scene)
     : _scene(scene)
@@ -33,39 +36,102 @@ QGVEdge::QGVEdge(QGVEdgePrivate *edge, QGVScene *scene)
 
 QGVEdge::~QGVEdge()
 {
-    _scene->removeItem(this);
-    delete _edge;
+    // Items created within a batch update may not be part of the scene yet.
+    if (scene())
+        _scene->removeItem(this);
+    _scene->_pools->edges.destroy(_edge);
 }
 
 QString QGVEdge::label() const
 {
-    return getAttribute("label");
+    return getAttribute(QGVAttributeKey::Label);
 }
 
 QRectF QGVEdge::boundingRect() const
 {
-    return _path.boundingRect() | _head_arrow.boundingRect() | _tail_arrow.boundingRect() | _label_rect;
+    const qreal margin = _pen.widthF()/2;
+    return (_path.boundingRect() | _head_arrow.boundingRect() | _tail_arrow.boundingRect()).adjusted(-margin, -margin, margin, margin)
+           | _label_rect;
 }
 
 QPainterPath QGVEdge::shape() const
+{
+    return _shape;
+}
+
+bool QGVEdge::contains(const QPointF &point) const
+{
+    // Rule out points far away from the flattened path before testing the
+    // stroked shape.
+    for (const auto &polyline: _polylines)
+    {
+        for (int i = 1; i < polyline.size(); i++)
+        {
+            if (QGVCore::distanceToSegment(point, polyline[i-1], polyline[i]) <= _hitDistance)
+                return _shape.contains(point);
+        }
+    }
+    return false;
+}
+
+void QGVEdge::updateShape()
 {
     QPainterPathStroker ps;
     ps.setCapStyle(_pen.capStyle());
     ps.setWidth(_pen.widthF() + 10);
     ps.setJoinStyle(_pen.joinStyle());
     ps.setMiterLimit(_pen.miterLimit());
-    return ps.createStroke(_path);
+    _shape = ps.createStroke(_path);
+
+    _polylines = _path.toSubpathPolygons();
+    // Half the stroke width plus slack for the flattening error
+    _hitDistance = (_pen.widthF() + 10)/2 + 1;
+}
+
+QVector<QRectF> QGVEdge::segmentRects() const
+{
+    QVector<QRectF> result;
+    QPointF last;
+
+    for (int i = 0; i < _path.elementCount(); i++)
+    {
+        const auto element = _path.elementAt(i);
+
+        if (element.isMoveTo())
+        {
+            last = element;
+            continue;
+        }
+
+        // A cubic stays within the hull of its control points.
+        qreal left = qMin(last.x(), element.x), right = qMax(last.x(), element.x);
+        qreal top = qMin(last.y(), element.y), bottom = qMax(last.y(), element.y);
+        last = element;
+
+        while (i + 1 < _path.elementCount() && _path.elementAt(i + 1).type == QPainterPath::CurveToDataElement)
+        {
+            last = _path.elementAt(++i);
+            left = qMin(left, last.x());
+            right = qMax(right, last.x());
+            top = qMin(top, last.y());
+            bottom = qMax(bottom, last.y());
+        }
+
+        result.append(QRectF(QPointF(left, top), QPointF(right, bottom))
+                      .adjusted(-_hitDistance, -_hitDistance, _hitDistance, _hitDistance));
+    }
+
+    return result;
 }
 
 void QGVEdge::setLabel(const QString &label)
 {
-    setAttribute("label", label);
+    setAttribute(QGVAttributeKey::Label, label);
 }
 
 void QGVEdge::setAttribute(const QString &name, const QString &value)
 {
-    char empty[] = "";
-    agsafeset(_edge->edge(), name.toLocal8Bit().data(), value.toLocal8Bit().data(), empty);
+    setAttribute(QGVAttributeKey(name.toLocal8Bit()), value);
 }
 
 QString QGVEdge::getAttribute(const QString &name) const
@@ -76,33 +142,42 @@ QString QGVEdge::getAttribute(const QString &name) const
     return QString();
 }
 
-void QGVEdge::paint(QPainter * painter, const QStyleOptionGraphicsItem *, QWidget *)
+void QGVEdge::setAttribute(const QGVAttributeKey &key, const QString &value)
 {
-    const bool isInvis = getAttribute("style").toLower() == "invis";
+    agxset(_edge->edge(), _scene->attributeSymbol(AGEDGE, key, true), value.toLocal8Bit().data());
 
-    if (labelItem_) labelItem_->setVisible(!isInvis);
-    if (headLabelItem_) headLabelItem_->setVisible(!isInvis);
-    if (tailLabelItem_) tailLabelItem_->setVisible(!isInvis);
+    _scene->attributeChanged(this, key);
+}
 
-    if (isInvis)
-        return;
+QString QGVEdge::getAttribute(const QGVAttributeKey &key) const
+{
+    if (Agsym_t *symbol = _scene->attributeSymbol(AGEDGE, key, false))
+        return agxget(_edge->edge(), symbol);
+    return QString();
+}
 
-    painter->save();
+void QGVEdge::paint(QPainter * painter, const QStyleOptionGraphicsItem *, QWidget *)
+{
+    if (_invisible)
+        return;
 
-    if(isSelected())
+    if (QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform()) < _scene->edgeDetailThreshold())
     {
-        QPen tpen(_pen);
-        tpen.setColor(_pen.color().darker(120));
-        tpen.setStyle(Qt::DotLine);
-        painter->setPen(tpen);
+        if (!_scene->hideLowDetailEdges())
+        {
+            painter->setPen(isSelected() ? _selectedPen : _pen);
+            painter->drawPath(_lowDetailPath);
+        }
+        return;
     }
-    else
-        painter->setPen(_pen);
 
+    painter->save();
+
+    painter->setPen(isSelected() ? _selectedPen : _pen);
 
     painter->drawPath(_path);
 
-    painter->setBrush(QBrush(_pen.color(), Qt::SolidPattern));
+    painter->setBrush(_arrowBrush);
     painter->drawPolygon(_head_arrow);
     painter->drawPolygon(_tail_arrow);
 
@@ -111,23 +186,14 @@ void QGVEdge::paint(QPainter * painter, const QStyleOptionGraphicsItem *, QWidge
 
 namespace
 {
-void update_label_item(QGraphicsTextItem *item, textlabel_t *label, qreal gheight)
+void update_label_item(QGVLabelItem *item, const QGVLabelLayout &label)
 {
     assert(item);
 
-    if (label)
+    if (label.valid)
     {
-        auto topt = item->document()->defaultTextOption();
-        topt.setAlignment(Qt::AlignCenter);
-        item->document()->setDefaultTextOption(topt);
-        item->setHtml(label->text);
-        item->adjustSize();
-
-        item->setPos(0, 0);
-        auto itemRect = item->boundingRect();
-        auto labelCenter = QGVCore::toPoint(label->pos, gheight);
-        itemRect.moveCenter(labelCenter);
-        item->setPos(itemRect.topLeft());
+        item->setText(label.text);
+        item->setCenter(label.center);
         item->show();
     }
     else
@@ -137,71 +203,102 @@ void update_label_item(QGraphicsTextItem *item, textlabel_t *label, qreal gheigh
 
 void QGVEdge::updateLayout()
 {
-    prepareGeometryChange();
-
-    qreal gheight = QGVCore::graphHeight(_scene->_graph->graph());
+    updateLayout(QGVLayoutData::edgeLayout(_edge->edge(), GD_bb(_scene->_graph->graph())));
+}
 
-    const splines* spl = ED_spl(_edge->edge());
-    _path = QGVCore::toPath(spl, gheight);
+void QGVEdge::updateLayout(const QGVEdgeLayout &layout)
+{
+    prepareGeometryChange();
 
+    _path = layout.path;
+    _head_arrow = layout.headArrow;
+    _tail_arrow = layout.tailArrow;
 
-    //Edge arrows
-    if((spl->list != 0) && (spl->list->size%3 == 1))
+    // Straight lines through the end points of the path segments
+    _lowDetailPath = QPainterPath();
+    for (int i = 0; i < _path.elementCount(); i++)
     {
-        if(spl->list->sflag)
-        {
-            _tail_arrow = toArrow(QLineF(QGVCore::toPoint(spl->list->list[0], gheight), QGVCore::toPoint(spl->list->sp, gheight)));
-        }
+        const auto element = _path.elementAt(i);
 
-        if(spl->list->eflag)
-        {
-            _head_arrow = toArrow(QLineF(QGVCore::toPoint(spl->list->list[spl->list->size-1], gheight), QGVCore::toPoint(spl->list->ep, gheight)));
-        }
+        if (element.isMoveTo())
+            _lowDetailPath.moveTo(element);
+        else if (element.isLineTo() || (element.type == QPainterPath::CurveToDataElement &&
+                 (i + 1 == _path.elementCount() || _path.elementAt(i + 1).type != QPainterPath::CurveToDataElement)))
+            _lowDetailPath.lineTo(element);
     }
 
-    _pen.setWidth(1);
-    _pen.setColor(QGVCore::toColor(getAttribute("color")));
-    _pen.setStyle(QGVCore::toPenStyle(getAttribute("style")));
-
     // Edge label handling
-    auto label_update_helper = [this, gheight] (QGraphicsTextItem **labelItemP, textlabel_t *label)
+    auto label_update_helper = [this] (QGVLabelItem **labelItemP, const QGVLabelLayout &label)
     {
         assert(labelItemP);
 
-        if (label)
+        if (label.valid)
         {
             if (!*labelItemP)
-                *labelItemP = new QGraphicsTextItem(this);
+                *labelItemP = new QGVLabelItem(_scene, this);
 
-            update_label_item(*labelItemP, label, gheight);
+            update_label_item(*labelItemP, label);
         }
         else if (*labelItemP)
+        {
+            (*labelItemP)->setText(QString());
             (*labelItemP)->hide();
+        }
     };
 
-    textlabel_t *label = ED_label(_edge->edge());
+    label_update_helper(&labelItem_, layout.label);
+    label_update_helper(&headLabelItem_, layout.headLabel);
+    label_update_helper(&tailLabelItem_, layout.tailLabel);
+
+    updateRenderState();
+    updateShape();
+}
 
-    if (!label)
-       label = ED_xlabel(_edge->edge());
+void QGVEdge::updateRenderState()
+{
+    const QString style = getAttribute(QGVAttributeKey::Style);
+    const qreal previousWidth = _pen.widthF();
+    const qreal width = QGVCore::toPenWidth(getAttribute(QGVAttributeKey::PenWidth));
 
-    label_update_helper(&labelItem_, label);
+    _invisible = QGVCore::isInvisible(style);
 
-    label_update_helper(&headLabelItem_, ED_head_label(_edge->edge()));
-    label_update_helper(&tailLabelItem_, ED_tail_label(_edge->edge()));
+    // The bounding rectangle covers the pen
+    if (width != previousWidth)
+        prepareGeometryChange();
+    _pen.setWidthF(width);
+    _pen.setColor(QGVCore::toColor(getAttribute(QGVAttributeKey::Color)));
+    _pen.setStyle(QGVCore::toPenStyle(style));
 
-    setToolTip(getAttribute("tooltip"));
-}
+    _selectedPen = _pen;
+    _selectedPen.setColor(_pen.color().darker(120));
+    _selectedPen.setStyle(Qt::DotLine);
 
-QPolygonF QGVEdge::toArrow(const QLineF &line) const
-{
-    QLineF n = line.normalVector();
-    QPointF o(n.dx() / 3.0, n.dy() / 3.0);
+    _arrowBrush = QBrush(_pen.color(), Qt::SolidPattern);
 
-    //Only support normal arrow type
-    QPolygonF polygon;
-    polygon.append(line.p1() + o);
-    polygon.append(line.p2());
-    polygon.append(line.p1() - o);
+    // The hit test shape only depends on the pen width
+    if (_pen.widthF() != previousWidth)
+        updateShape();
+
+    // Head and tail labels use labelfontcolor, falling back to fontcolor
+    const QString fontColor = getAttribute(QGVAttributeKey::FontColor);
+    const QString labelFontColor = getAttribute(QGVAttributeKey::LabelFontColor);
+
+    if (labelItem_)
+        labelItem_->setColor(QGVCore::toColor(fontColor));
+
+    for (auto item: { headLabelItem_, tailLabelItem_ })
+    {
+        if (item)
+            item->setColor(QGVCore::toColor(labelFontColor.isEmpty() ? fontColor : labelFontColor));
+    }
+
+    for (auto item: { labelItem_, headLabelItem_, tailLabelItem_ })
+    {
+        // Labels without layout are cleared
+        if (item)
+            item->setVisible(!_invisible && !item->isEmpty());
+    }
 
-    return polygon;
+    setToolTip(getAttribute(QGVAttributeKey::Tooltip));
+    update();
 }
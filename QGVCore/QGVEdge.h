@@ -19,12 +19,16 @@ License along with this library.
 #define QGVEDGE_H
 
 #include "qgv_export.h"
+#include "QGVAttribute.h"
 #include <QGraphicsItem>
 #include <QPen>
+#include <QVector>
 
 class QGVNode;
 class QGVScene;
 class QGVEdgePrivate;
+class QGVLabelItem;
+struct QGVEdgeLayout;
 
 /**
  * @brief Edge item
@@ -38,6 +42,7 @@ public:
     QString label() const;
     QRectF boundingRect() const;
     QPainterPath shape() const;
+    bool contains(const QPointF &point) const;
 
     void setLabel(const QString &label);
 
@@ -45,6 +50,9 @@ public:
 
     void setAttribute(const QString &name, const QString &value);
     QString getAttribute(const QString &name) const;
+    // Same as above through the scene's cached attribute symbols
+    void setAttribute(const QGVAttributeKey &key, const QString &value);
+    QString getAttribute(const QGVAttributeKey &key) const;
 
     void updateLayout();
 
@@ -57,25 +65,39 @@ public:
 private:
     QGVEdge(QGVEdgePrivate *edge, QGVScene *scene);
 
-    QPolygonF toArrow(const QLineF &normal) const;
+    void updateLayout(const QGVEdgeLayout &layout);
+    // Caches everything paint() needs from the cgraph attributes
+    void updateRenderState();
+    // Rebuilds the cached hit test geometry from the path and the pen
+    void updateShape();
+    // Bounds of each line and curve of the path, grown by the hit distance
+    QVector<QRectF> segmentRects() const;
 
     friend class QGVScene;
+    friend class QGVItemIndex;
     //friend class QGVSubGraph;
 
     QGVScene *_scene;
     QGVEdgePrivate* _edge;
 
     QPainterPath _path;
+    QPainterPath _shape;
+    QPainterPath _lowDetailPath;
+    QList<QPolygonF> _polylines;  // flattened _path for the coarse hit test
+    qreal _hitDistance = 0.0;
     QPen _pen;
+    QPen _selectedPen;
+    QBrush _arrowBrush;
+    bool _invisible = false;
     QPolygonF _head_arrow;
     QPolygonF _tail_arrow;
 
     QString _label;
     QRectF _label_rect;
 
-    QGraphicsTextItem *labelItem_ = nullptr;
-    QGraphicsTextItem *headLabelItem_ = nullptr;
-    QGraphicsTextItem *tailLabelItem_ = nullptr;
+    QGVLabelItem *labelItem_ = nullptr;
+    QGVLabelItem *headLabelItem_ = nullptr;
+    QGVLabelItem *tailLabelItem_ = nullptr;
 };
 
 #endif // QGVEDGE_H
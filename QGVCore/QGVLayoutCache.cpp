@@ -0,0 +1,292 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#include "QGVLayoutCache.h"
+#include <QGVLayoutData.h>
+#include <QCache>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+
+namespace
+{
+const quint32 DiskMagic = 0x51475643; // "QGVC"
+const quint32 DiskVersion = 1;
+const char *DiskSuffix = ".qgvlayout";
+
+// The disk tier is trimmed to this share of the budget, so it is only
+// scanned again after a batch of inserts.
+const qreal DiskTrimRatio = 0.75;
+
+// Bounding box attribute gvLayout() writes to the graph
+const QByteArray BoundingBox = "bb=\"";
+
+bool is_id_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+}
+
+class QGVLayoutCachePrivate
+{
+public:
+    QString filePath(const QByteArray &key) const
+    {
+        return QDir(diskDirectory).filePath(QString::fromLatin1(key.toHex()) + DiskSuffix);
+    }
+
+    bool readFile(const QByteArray &key, QGVLayoutData *layout) const;
+    // Returns the size of the written file, 0 on failure
+    qint64 writeFile(const QByteArray &key, const QGVLayoutData &layout);
+    void trimDisk();
+
+    mutable QMutex mutex;
+    QCache<QByteArray, QGVLayoutData> memory;
+    QString diskDirectory;
+    qint64 diskBudget = 64 * 1024 * 1024;
+    // Size of the disk tier as of the last trimDisk() plus the files written
+    // since, -1 if the directory has not been scanned yet
+    qint64 diskUsage = -1;
+    QGVLayoutCache::Stats stats;
+};
+
+bool QGVLayoutCachePrivate::readFile(const QByteArray &key, QGVLayoutData *layout) const
+{
+    QFile file(filePath(key));
+
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic = 0, version = 0;
+    in >> magic >> version;
+
+    if (magic != DiskMagic || version != DiskVersion)
+        return false;
+
+    in >> *layout;
+
+    if (in.status() != QDataStream::Ok || !layout->valid)
+        return false;
+
+    // Bump the modification time, the disk tier is trimmed oldest first.
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+#endif
+    return true;
+}
+
+qint64 QGVLayoutCachePrivate::writeFile(const QByteArray &key, const QGVLayoutData &layout)
+{
+    if (!QDir().mkpath(diskDirectory))
+    {
+        qWarning() << "Could not create layout cache directory" << diskDirectory;
+        return 0;
+    }
+
+    QSaveFile file(filePath(key));
+
+    if (!file.open(QIODevice::WriteOnly))
+        return 0;
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_6);
+    out << DiskMagic << DiskVersion << layout;
+    const qint64 size = file.size();
+
+    if (out.status() != QDataStream::Ok || !file.commit())
+    {
+        qWarning() << "Could not write layout cache file" << file.fileName();
+        return 0;
+    }
+
+    return size;
+}
+
+void QGVLayoutCachePrivate::trimDisk()
+{
+    QDir dir(diskDirectory);
+    const auto entries = dir.entryInfoList({ QString("*") + DiskSuffix }, QDir::Files, QDir::Time);
+    const qint64 limit = qint64(diskBudget * DiskTrimRatio);
+    qint64 total = 0;
+    diskUsage = 0;
+
+    for (const auto &entry: entries)
+    {
+        total += entry.size();
+
+        if (total > limit)
+            QFile::remove(entry.absoluteFilePath());
+        else
+            diskUsage = total;
+    }
+}
+
+QGVLayoutCache::QGVLayoutCache(int maxMemoryEntries)
+    : d(new QGVLayoutCachePrivate)
+{
+    d->memory.setMaxCost(maxMemoryEntries);
+}
+
+QGVLayoutCache::~QGVLayoutCache()
+{
+    delete d;
+}
+
+int QGVLayoutCache::maxMemoryEntries() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->memory.maxCost();
+}
+
+void QGVLayoutCache::setMaxMemoryEntries(int count)
+{
+    QMutexLocker locker(&d->mutex);
+    d->memory.setMaxCost(count);
+}
+
+QString QGVLayoutCache::diskCacheDirectory() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->diskDirectory;
+}
+
+void QGVLayoutCache::setDiskCacheDirectory(const QString &path)
+{
+    QMutexLocker locker(&d->mutex);
+    d->diskDirectory = path;
+    d->diskUsage = -1;
+}
+
+qint64 QGVLayoutCache::diskCacheBudget() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->diskBudget;
+}
+
+void QGVLayoutCache::setDiskCacheBudget(qint64 bytes)
+{
+    QMutexLocker locker(&d->mutex);
+    d->diskBudget = bytes;
+
+    if (!d->diskDirectory.isEmpty())
+        d->trimDisk();
+}
+
+void QGVLayoutCache::clear()
+{
+    QMutexLocker locker(&d->mutex);
+    d->memory.clear();
+
+    if (!d->diskDirectory.isEmpty())
+    {
+        QDir dir(d->diskDirectory);
+
+        for (const auto &name: dir.entryList({ QString("*") + DiskSuffix }, QDir::Files))
+            dir.remove(name);
+        d->diskUsage = 0;
+    }
+}
+
+QGVLayoutCache::Stats QGVLayoutCache::stats() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->stats;
+}
+
+QByteArray QGVLayoutCache::key(const QByteArray &dot, const QByteArray &engine, const QByteArray &options)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(engine);
+    hash.addData("\0", 1);
+    hash.addData(options);
+    hash.addData("\0", 1);
+
+    // Leave out the bounding boxes, the result of a previous layout. The
+    // key stays the same after the scene graph has been laid out.
+    int begin = 0;
+    int bb = 0;
+
+    while ((bb = dot.indexOf(BoundingBox, bb)) >= 0)
+    {
+        const int end = dot.indexOf('"', bb + BoundingBox.size());
+
+        if (end < 0)
+            break;
+
+        if (bb == 0 || !is_id_char(dot.at(bb - 1)))
+        {
+            hash.addData(dot.constData() + begin, bb - begin);
+            begin = end + 1;
+        }
+
+        bb = end + 1;
+    }
+
+    hash.addData(dot.constData() + begin, dot.size() - begin);
+    return hash.result();
+}
+
+bool QGVLayoutCache::find(const QByteArray &key, QGVLayoutData *layout)
+{
+    QMutexLocker locker(&d->mutex);
+
+    if (auto cached = d->memory.object(key))
+    {
+        *layout = *cached;
+        ++d->stats.memoryHits;
+        return true;
+    }
+
+    if (!d->diskDirectory.isEmpty() && d->readFile(key, layout))
+    {
+        d->memory.insert(key, new QGVLayoutData(*layout), 1);
+        ++d->stats.diskHits;
+        return true;
+    }
+
+    ++d->stats.misses;
+    return false;
+}
+
+void QGVLayoutCache::insert(const QByteArray &key, const QGVLayoutData &layout)
+{
+    if (!layout.valid)
+        return;
+
+    QMutexLocker locker(&d->mutex);
+    d->memory.insert(key, new QGVLayoutData(layout), 1);
+
+    if (!d->diskDirectory.isEmpty())
+    {
+        const qint64 written = d->writeFile(key, layout);
+
+        if (d->diskUsage >= 0)
+            d->diskUsage += written;
+
+        // Scans the directory only once the budget may be exceeded
+        if (d->diskUsage < 0 || d->diskUsage > d->diskBudget)
+            d->trimDisk();
+    }
+}
@@ -0,0 +1,81 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#ifndef QGVLAYOUTCACHE_H
+#define QGVLAYOUTCACHE_H
+
+#include "qgv_export.h"
+#include <QByteArray>
+#include <QString>
+
+class QGVLayoutCachePrivate;
+struct QGVLayoutData;
+
+/**
+ * @brief Content addressed cache of computed layouts
+ *
+ * Layouts are keyed on a hash of the DOT text of the graph, the layout engine
+ * and its options. Recently used layouts are kept in memory, optionally
+ * backed by a directory on disk which is trimmed to a size budget.
+ *
+ * A cache may be shared by several scenes. It is not owned by the scenes.
+ */
+class QGVCORE_EXPORT QGVLayoutCache
+{
+public:
+    struct Stats
+    {
+        quint64 memoryHits = 0;
+        quint64 diskHits = 0;
+        quint64 misses = 0;
+    };
+
+    explicit QGVLayoutCache(int maxMemoryEntries = 32);
+    ~QGVLayoutCache();
+
+    int maxMemoryEntries() const;
+    void setMaxMemoryEntries(int count);
+
+    // An empty path disables the disk tier. Files written by other caches
+    // sharing the directory are only noticed when the tier is trimmed.
+    QString diskCacheDirectory() const;
+    void setDiskCacheDirectory(const QString &path);
+
+    qint64 diskCacheBudget() const;
+    void setDiskCacheBudget(qint64 bytes);
+
+    // Removes all entries from memory and disk.
+    void clear();
+
+    Stats stats() const;
+
+    // Bounding boxes (bb attributes) written by an earlier layout are not
+    // part of the key.
+    static QByteArray key(const QByteArray &dot, const QByteArray &engine, const QByteArray &options = {});
+
+private:
+    friend class QGVScene;
+    QGVLayoutCache(const QGVLayoutCache &) = delete;
+    QGVLayoutCache &operator=(const QGVLayoutCache &) = delete;
+
+    bool find(const QByteArray &key, QGVLayoutData *layout);
+    void insert(const QByteArray &key, const QGVLayoutData &layout);
+
+    QGVLayoutCachePrivate *d;
+};
+
+#endif // QGVLAYOUTCACHE_H
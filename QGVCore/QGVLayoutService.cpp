@@ -0,0 +1,579 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#include "QGVLayoutService.h"
+#include <QGVLayoutData.h>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QList>
+#include <QPointer>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QThread>
+#include <QTimer>
+#include <QtEndian>
+#include <algorithm>
+#include <cstdio>
+
+#ifdef Q_OS_WIN
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace
+{
+const quint32 ProtocolVersion = 1;
+const int FrameHeaderSize = sizeof(quint32);
+
+// Messages are framed by their size as a big endian quint32
+QByteArray frame(const QByteArray &payload)
+{
+    QByteArray result(FrameHeaderSize, Qt::Uninitialized);
+    qToBigEndian<quint32>(payload.size(), result.data());
+    return result + payload;
+}
+
+QByteArray encode_request(quint64 id, const QByteArray &dot, const QGVLayoutRequest &request)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_6);
+    out << ProtocolVersion << id << request.engine << request.options << dot;
+    return frame(payload);
+}
+
+QByteArray encode_reply(quint64 id, const QGVLayoutData &layout)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_6);
+    out << ProtocolVersion << id << layout << layout.layoutTime << layout.conversionTime;
+    return frame(payload);
+}
+
+bool read_fully(QFile &file, char *data, qint64 size)
+{
+    while (size > 0)
+    {
+        const qint64 count = file.read(data, size);
+
+        if (count <= 0)
+            return false;
+
+        data += count;
+        size -= count;
+    }
+    return true;
+}
+
+QString default_program()
+{
+#ifdef Q_OS_WIN
+    const QString name = QStringLiteral("qgv_layout_worker.exe");
+#else
+    const QString name = QStringLiteral("qgv_layout_worker");
+#endif
+    return QDir(QCoreApplication::applicationDirPath()).filePath(name);
+}
+}
+
+struct QGVLayoutJob
+{
+    quint64 id = 0;
+    int priority = 0;
+    int timeout = 0;
+    QByteArray frame;   // sent once the worker is running
+    QPointer<QObject> context;
+    std::function<void (const QGVLayoutData &layout)> done;
+};
+
+struct QGVLayoutWorker
+{
+    QProcess *process = nullptr;
+    QTimer *timer = nullptr;
+    QGVLayoutJob job;   // id 0 while idle
+    QByteArray buffer;
+};
+
+class QGVLayoutServicePrivate
+{
+public:
+    explicit QGVLayoutServicePrivate(QGVLayoutService *service)
+        : q(service)
+    {
+    }
+
+    // Workers are looked up by their process, the handlers of a retired
+    // worker may still be pending.
+    QGVLayoutWorker *workerFor(QProcess *process) const;
+    QGVLayoutWorker *startWorker();
+    void schedule();
+    void send(QGVLayoutWorker *worker);
+    void readReplies(QProcess *process);
+    void workerExited(QProcess *process);
+    void timedOut(QProcess *process);
+    // Removes the worker from the pool and kills its process
+    void retire(QGVLayoutWorker *worker);
+    void retireIdleWorkers(int keep);
+    void deliver(const QGVLayoutJob &job, const QGVLayoutData &layout);
+
+    QGVLayoutService *q;
+    QString program = default_program();
+    QStringList arguments;
+    int maxWorkers = qMax(1, QThread::idealThreadCount());
+    int defaultTimeout = 0;
+    quint64 nextId = 1;
+    QList<QGVLayoutJob> queue;  // highest priority first
+    QList<QGVLayoutWorker *> workers;
+    QGVLayoutService::Stats stats;
+};
+
+QGVLayoutWorker *QGVLayoutServicePrivate::workerFor(QProcess *process) const
+{
+    for (auto worker: workers)
+    {
+        if (worker->process == process)
+            return worker;
+    }
+    return nullptr;
+}
+
+QGVLayoutWorker *QGVLayoutServicePrivate::startWorker()
+{
+    auto worker = new QGVLayoutWorker;
+    worker->process = new QProcess(q);
+    worker->timer = new QTimer(worker->process);
+    worker->timer->setSingleShot(true);
+    workers.append(worker);
+    ++stats.workersStarted;
+
+    QProcess *process = worker->process;
+    // Graphviz warnings end up on the stderr of the application as before
+    process->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+
+    QObject::connect(process, &QProcess::started, process, [this, process] ()
+    {
+        if (auto worker = workerFor(process))
+            send(worker);
+    });
+
+    QObject::connect(process, &QProcess::readyReadStandardOutput, process, [this, process] ()
+    {
+        readReplies(process);
+    });
+
+    QObject::connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), process, [this, process] ()
+    {
+        workerExited(process);
+    });
+
+    QObject::connect(process, &QProcess::errorOccurred, process, [this, process] (QProcess::ProcessError error)
+    {
+        if (error == QProcess::FailedToStart)
+            workerExited(process);
+    });
+
+    QObject::connect(worker->timer, &QTimer::timeout, process, [this, process] ()
+    {
+        timedOut(process);
+    });
+
+    process->start(program, arguments);
+
+    // Null if the start failed right away
+    return workerFor(process);
+}
+
+void QGVLayoutServicePrivate::schedule()
+{
+    while (!queue.isEmpty())
+    {
+        auto it = std::find_if(workers.begin(), workers.end(), [] (QGVLayoutWorker *worker)
+        {
+            return worker->job.id == 0;
+        });
+
+        QGVLayoutWorker *worker = it != workers.end() ? *it : nullptr;
+
+        if (!worker)
+        {
+            if (workers.size() >= maxWorkers)
+                return;
+
+            worker = startWorker();
+        }
+
+        if (!worker)
+        {
+            const QGVLayoutJob job = queue.takeFirst();
+            ++stats.failed;
+            deliver(job, QGVLayoutData());
+            continue;
+        }
+
+        worker->job = queue.takeFirst();
+
+        if (worker->job.timeout > 0)
+            worker->timer->start(worker->job.timeout);
+
+        if (worker->process->state() == QProcess::Running)
+            send(worker);
+    }
+}
+
+void QGVLayoutServicePrivate::send(QGVLayoutWorker *worker)
+{
+    if (worker->job.frame.isEmpty())
+        return;
+
+    worker->process->write(worker->job.frame);
+    worker->job.frame.clear();
+}
+
+void QGVLayoutServicePrivate::readReplies(QProcess *process)
+{
+    QGVLayoutWorker *worker = workerFor(process);
+
+    if (!worker)
+        return;
+
+    worker->buffer += process->readAllStandardOutput();
+
+    while (worker->buffer.size() >= FrameHeaderSize)
+    {
+        const quint32 size = qFromBigEndian<quint32>(worker->buffer.constData());
+
+        if (quint32(worker->buffer.size() - FrameHeaderSize) < size)
+            return;
+
+        QDataStream in(worker->buffer.mid(FrameHeaderSize, size));
+        in.setVersion(QDataStream::Qt_5_6);
+        worker->buffer.remove(0, FrameHeaderSize + size);
+
+        quint32 version = 0;
+        quint64 id = 0;
+        QGVLayoutData layout;
+        in >> version >> id >> layout >> layout.layoutTime >> layout.conversionTime;
+
+        if (version != ProtocolVersion || in.status() != QDataStream::Ok || id == 0 || id != worker->job.id)
+        {
+            // Out of sync with the worker, the rest of its output cannot be
+            // trusted either. Replace it like a worker that timed out.
+            qWarning() << "Unexpected reply from layout worker" << program;
+            const QGVLayoutJob job = worker->job;
+            retire(worker);
+
+            if (job.id)
+                ++stats.failed;
+
+            schedule();
+
+            if (job.id)
+                deliver(job, QGVLayoutData());
+            return;
+        }
+
+        const QGVLayoutJob job = worker->job;
+        worker->job = QGVLayoutJob();
+        worker->timer->stop();
+
+        if (layout.valid)
+            ++stats.completed;
+        else
+            ++stats.failed;
+
+        schedule();
+        deliver(job, layout);
+
+        // The callback may have cancelled the next job of the worker
+        worker = workerFor(process);
+
+        if (!worker)
+            return;
+    }
+}
+
+void QGVLayoutServicePrivate::workerExited(QProcess *process)
+{
+    QGVLayoutWorker *worker = workerFor(process);
+
+    if (!worker)
+        return;
+
+    // A result written right before the exit
+    readReplies(process);
+    worker = workerFor(process);
+
+    if (!worker)
+        return;
+
+    const QGVLayoutJob job = worker->job;
+    retire(worker);
+
+    if (job.id)
+    {
+        qWarning() << "Layout worker" << program << "exited during a layout:" << process->errorString();
+        ++stats.crashed;
+        ++stats.failed;
+    }
+
+    // Replaces the worker if there are jobs waiting
+    schedule();
+
+    if (job.id)
+        deliver(job, QGVLayoutData());
+}
+
+void QGVLayoutServicePrivate::timedOut(QProcess *process)
+{
+    QGVLayoutWorker *worker = workerFor(process);
+
+    if (!worker || !worker->job.id)
+        return;
+
+    const QGVLayoutJob job = worker->job;
+    qWarning() << "Layout worker" << program << "killed after" << job.timeout << "ms";
+    ++stats.timedOut;
+    ++stats.failed;
+    retire(worker);
+    schedule();
+    deliver(job, QGVLayoutData());
+}
+
+void QGVLayoutServicePrivate::retire(QGVLayoutWorker *worker)
+{
+    workers.removeOne(worker);
+
+    QProcess *process = worker->process;
+    worker->timer->stop();
+    worker->timer->disconnect();
+    process->disconnect();
+
+    if (process->state() == QProcess::NotRunning)
+    {
+        process->deleteLater();
+    }
+    else
+    {
+        QObject::connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+                         process, &QObject::deleteLater);
+        process->kill();
+    }
+
+    delete worker;
+}
+
+void QGVLayoutServicePrivate::retireIdleWorkers(int keep)
+{
+    for (auto worker: QList<QGVLayoutWorker *>(workers))
+    {
+        if (workers.size() <= keep)
+            return;
+
+        if (!worker->job.id)
+            retire(worker);
+    }
+}
+
+void QGVLayoutServicePrivate::deliver(const QGVLayoutJob &job, const QGVLayoutData &layout)
+{
+    if (job.context && job.done)
+        job.done(layout);
+}
+
+QGVLayoutService::QGVLayoutService(QObject *parent)
+    : QObject(parent)
+    , d(new QGVLayoutServicePrivate(this))
+{
+}
+
+QGVLayoutService::~QGVLayoutService()
+{
+    // Kill the workers without reporting their jobs
+    for (auto worker: d->workers)
+    {
+        worker->timer->disconnect();
+        worker->process->disconnect();
+        delete worker->process;
+        delete worker;
+    }
+    delete d;
+}
+
+QString QGVLayoutService::workerProgram() const
+{
+    return d->program;
+}
+
+QStringList QGVLayoutService::workerArguments() const
+{
+    return d->arguments;
+}
+
+void QGVLayoutService::setWorkerProgram(const QString &program, const QStringList &arguments)
+{
+    d->program = program;
+    d->arguments = arguments;
+    d->retireIdleWorkers(0);
+}
+
+bool QGVLayoutService::isAvailable() const
+{
+    const QFileInfo info(d->program);
+
+    if (info.isAbsolute())
+        return info.isFile() && info.isExecutable();
+    return !QStandardPaths::findExecutable(d->program).isEmpty();
+}
+
+int QGVLayoutService::maxWorkers() const
+{
+    return d->maxWorkers;
+}
+
+void QGVLayoutService::setMaxWorkers(int count)
+{
+    d->maxWorkers = qMax(1, count);
+    d->retireIdleWorkers(d->maxWorkers);
+    d->schedule();
+}
+
+int QGVLayoutService::defaultTimeout() const
+{
+    return d->defaultTimeout;
+}
+
+void QGVLayoutService::setDefaultTimeout(int msecs)
+{
+    d->defaultTimeout = qMax(0, msecs);
+}
+
+int QGVLayoutService::queuedJobs() const
+{
+    return d->queue.size();
+}
+
+int QGVLayoutService::runningJobs() const
+{
+    return std::count_if(d->workers.begin(), d->workers.end(), [] (QGVLayoutWorker *worker)
+    {
+        return worker->job.id != 0;
+    });
+}
+
+QGVLayoutService::Stats QGVLayoutService::stats() const
+{
+    return d->stats;
+}
+
+quint64 QGVLayoutService::submit(const QByteArray &dot, const QGVLayoutRequest &request, int priority, int timeout,
+                                 QObject *context, const Callback &done)
+{
+    QGVLayoutJob job;
+    job.id = d->nextId++;
+    job.priority = priority;
+    job.timeout = timeout < 0 ? d->defaultTimeout : timeout;
+    job.frame = encode_request(job.id, dot, request);
+    job.context = context;
+    job.done = done;
+
+    // Behind the queued jobs of the same priority
+    auto it = std::find_if(d->queue.begin(), d->queue.end(), [priority] (const QGVLayoutJob &queued)
+    {
+        return queued.priority < priority;
+    });
+
+    d->queue.insert(it, job);
+    d->schedule();
+    return job.id;
+}
+
+void QGVLayoutService::cancel(quint64 job)
+{
+    for (int i = 0; i < d->queue.size(); ++i)
+    {
+        if (d->queue.at(i).id == job)
+        {
+            d->queue.removeAt(i);
+            ++d->stats.cancelled;
+            return;
+        }
+    }
+
+    for (auto worker: d->workers)
+    {
+        if (worker->job.id == job)
+        {
+            ++d->stats.cancelled;
+            d->retire(worker);
+            d->schedule();
+            return;
+        }
+    }
+}
+
+int QGVLayoutService::runWorker()
+{
+#ifdef Q_OS_WIN
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    QFile in, out;
+
+    if (!in.open(stdin, QIODevice::ReadOnly | QIODevice::Unbuffered)
+        || !out.open(stdout, QIODevice::WriteOnly | QIODevice::Unbuffered))
+        return 1;
+
+    forever
+    {
+        char header[FrameHeaderSize];
+
+        // Closed by the service
+        if (!read_fully(in, header, FrameHeaderSize))
+            return 0;
+
+        QByteArray payload(qFromBigEndian<quint32>(header), Qt::Uninitialized);
+
+        if (!read_fully(in, payload.data(), payload.size()))
+            return 1;
+
+        QDataStream stream(payload);
+        stream.setVersion(QDataStream::Qt_5_6);
+
+        quint32 version = 0;
+        quint64 id = 0;
+        QByteArray dot;
+        QGVLayoutRequest request;
+        stream >> version >> id >> request.engine >> request.options >> dot;
+
+        if (version != ProtocolVersion || stream.status() != QDataStream::Ok)
+        {
+            qWarning() << "Unexpected layout job, protocol version" << version;
+            return 1;
+        }
+
+        const QByteArray reply = encode_reply(id, QGVLayoutData::compute(dot, request));
+
+        if (out.write(reply) != reply.size() || !out.flush())
+            return 1;
+    }
+}
@@ -0,0 +1,106 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#ifndef QGVLAYOUTSERVICE_H
+#define QGVLAYOUTSERVICE_H
+
+#include "qgv_export.h"
+#include <QObject>
+#include <QStringList>
+#include <functional>
+
+class QGVLayoutServicePrivate;
+struct QGVLayoutData;
+struct QGVLayoutRequest;
+
+/**
+ * @brief Pool of worker processes computing layouts
+ *
+ * Graphviz can only be used from one thread at a time, so all layouts of a
+ * process run one after the other. The service runs them in separate worker
+ * processes instead, one layout per worker at a time. Jobs are queued by
+ * priority, workers that crash or run past their timeout are killed and
+ * replaced on demand.
+ *
+ * The worker program is qgv_layout_worker, or any program whose main()
+ * calls runWorker(). A service may be shared by several scenes, see
+ * QGVScene::setLayoutService(). It is not owned by the scenes.
+ */
+class QGVCORE_EXPORT QGVLayoutService : public QObject
+{
+    Q_OBJECT
+public:
+    struct Stats
+    {
+        quint64 completed = 0;
+        quint64 failed = 0;             // including crashes and timeouts
+        quint64 crashed = 0;
+        quint64 timedOut = 0;
+        quint64 cancelled = 0;
+        quint64 workersStarted = 0;
+    };
+
+    explicit QGVLayoutService(QObject *parent = nullptr);
+    ~QGVLayoutService();
+
+    // Defaults to qgv_layout_worker in the directory of the application.
+    // Affects workers started afterwards.
+    QString workerProgram() const;
+    QStringList workerArguments() const;
+    void setWorkerProgram(const QString &program, const QStringList &arguments = {});
+
+    // Whether the worker program exists and is executable
+    bool isAvailable() const;
+
+    // Defaults to QThread::idealThreadCount()
+    int maxWorkers() const;
+    void setMaxWorkers(int count);
+
+    // Milliseconds a job may run before its worker is killed, 0 for no
+    // limit. Used for jobs submitted without a timeout of their own.
+    int defaultTimeout() const;
+    void setDefaultTimeout(int msecs);
+
+    int queuedJobs() const;
+    int runningJobs() const;
+    Stats stats() const;
+
+    // Worker side of the service, reads layout jobs from stdin and writes
+    // the results to stdout until stdin is closed. For the main() of a
+    // worker program, returns its exit code.
+    static int runWorker();
+
+private:
+    friend class QGVScene;
+    typedef std::function<void (const QGVLayoutData &layout)> Callback;
+
+    QGVLayoutService(const QGVLayoutService &) = delete;
+    QGVLayoutService &operator=(const QGVLayoutService &) = delete;
+
+    // Queues the layout, jobs with a higher priority are started first.
+    // done is called with the result, or an invalid layout if the job
+    // failed, unless context got destroyed or the job cancelled. A negative
+    // timeout selects defaultTimeout(). Returns the job id.
+    quint64 submit(const QByteArray &dot, const QGVLayoutRequest &request, int priority, int timeout,
+                   QObject *context, const Callback &done);
+    // Dequeues the job, or kills its worker if it is running
+    void cancel(quint64 job);
+
+    QGVLayoutServicePrivate *d;
+};
+
+#endif // QGVLAYOUTSERVICE_H
@@ -20,18 +20,20 @@ License along with this library.
 #include <QGVScene.h>
 #include <QGVGraphPrivate.h>
 #include <QGVNodePrivate.h>
-#include <QTextDocument>
+#include <QGVPrivatePools.h>
+#include <QGVLayoutData.h>
 #include <QDebug>
 #include <QPainter>
 #include <QStaticText>
 #include <QFontMetricsF>
 #include <QPicture>
-#include <QGraphicsTextItem>
+#include <QGVLabelItem.h>
+#include <QStyleOptionGraphicsItem>
 
 QGVNode::QGVNode(QGVNodePrivate *node, QGVScene *scene)
     : _scene(scene)
     , _node(node)
-    , textItem_(new QGraphicsTextItem(this))
+    , textItem_(new QGVLabelItem(scene, this))
 {
     setFlag(QGraphicsItem::ItemIsSelectable, true);
     textItem_->hide();
@@ -39,13 +41,15 @@ QGVNode::QGVNode(QGVNodePrivate *node, QGVScene *scene)
 
 QGVNode::~QGVNode()
 {
-    _scene->removeItem(this);
-    delete _node;
+    // Items created within a batch update may not be part of the scene yet.
+    if (scene())
+        _scene->removeItem(this);
+    _scene->_pools->nodes.destroy(_node);
 }
 
 QString QGVNode::label() const
 {
-    auto ret = getAttribute("label");
+    auto ret = getAttribute(QGVAttributeKey::Label);
     if (ret.isEmpty() || ret == "\\N")
         ret = name();
     return ret;
@@ -53,68 +57,68 @@ QString QGVNode::label() const
 
 void QGVNode::setLabel(const QString &label)
 {
-    setAttribute("label", label);
+    setAttribute(QGVAttributeKey::Label, label);
 }
 
 QString QGVNode::name() const
 {
-    if (char *n = agnameof(_node->node()))
-        return n;
-    return {};
+    return QString::fromUtf8(QGVCore::nameOf(_node->node()));
 }
 
 QRectF QGVNode::boundingRect() const
 {
-    return _path.boundingRect();
+    // Half of the outline is drawn outside of the shape
+    const qreal margin = _pen.widthF()/2;
+    return _path.boundingRect().adjusted(-margin, -margin, margin, margin);
 }
 
 void QGVNode::paint(QPainter * painter, const QStyleOptionGraphicsItem *, QWidget *)
 {
-    if (getAttribute("style").toLower() == "invis")
+    if (_invisible)
+        return;
+
+    if (QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform()) < _scene->labelDetailThreshold())
     {
-        textItem_->hide();
+        painter->fillRect(_path.boundingRect(), isSelected() ? _lowDetailColor.darker(120) : _lowDetailColor);
         return;
     }
 
-    if (_icon.isNull() && !label().isEmpty())
-        textItem_->show();
-
     painter->save();
 
     painter->setPen(_pen);
-
-    if(isSelected())
-    {
-        QBrush tbrush(_brush);
-        tbrush.setColor(tbrush.color().darker(120));
-        painter->setBrush(tbrush);
-    }
-    else
-        painter->setBrush(_brush);
+    painter->setBrush(isSelected() ? _selectedBrush : _brush);
 
     painter->drawPath(_path);
 
-    painter->setPen(QGVCore::toColor(getAttribute("labelfontcolor")));
-
-    const QRectF rect = boundingRect().adjusted(2,2,-2,-2); //Margin
-
-    if(_icon.isNull())
-    {
-    }
-    else
+    if(!_icon.isNull())
     {
-        painter->drawText(rect.adjusted(0,0,0, -rect.height()*2/3), Qt::AlignCenter , QGVNode::label());
+        const QRectF rect = _path.boundingRect().adjusted(2,2,-2,-2); //Margin
+
+        painter->setPen(_fontColor);
+        painter->drawText(rect.adjusted(0,0,0, -rect.height()*2/3), Qt::AlignCenter, _label);
 
         const QRectF img_rect = rect.adjusted(0, rect.height()/3,0, 0);
-        QImage img = _icon.scaled(img_rect.size().toSize(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
-        painter->drawImage(img_rect.topLeft() + QPointF((img_rect.width() - img.rect().width())/2, 0), img);
+        painter->drawImage(img_rect.topLeft() + QPointF((img_rect.width() - _scaledIcon.rect().width())/2, 0), _scaledIcon);
     }
     painter->restore();
 }
 
 void QGVNode::setAttribute(const QString &name, const QString &value)
 {
-    char empty[] = "";
+    setAttribute(QGVAttributeKey(name.toLocal8Bit()), value);
+}
+
+QString QGVNode::getAttribute(const QString &name) const
+{
+    char* value = agget(_node->node(), name.toLocal8Bit().data());
+    if(value)
+        return value;
+    return QString();
+}
+
+void QGVNode::setAttribute(const QGVAttributeKey &key, const QString &value)
+{
+    Agsym_t *symbol = _scene->attributeSymbol(AGNODE, key, true);
 
     if (value.startsWith('<') && value.endsWith('>'))
     {
@@ -125,20 +129,21 @@ void QGVNode::setAttribute(const QString &name, const QString &value)
         v.remove(0, 1);
         v.chop(1);
         char *html = agstrdup_html(_node->graph(), v.toLocal8Bit().data());
-        agsafeset(_node->node(), name.toLocal8Bit().data(), html, empty);
+        agxset(_node->node(), symbol, html);
         agstrfree(_node->graph(), html);
     }
     else
     {
-        agsafeset(_node->node(), name.toLocal8Bit().data(), value.toLocal8Bit().data(), empty);
+        agxset(_node->node(), symbol, value.toLocal8Bit().data());
     }
+
+    _scene->attributeChanged(this, key);
 }
 
-QString QGVNode::getAttribute(const QString &name) const
+QString QGVNode::getAttribute(const QGVAttributeKey &key) const
 {
-    char* value = agget(_node->node(), name.toLocal8Bit().data());
-    if(value)
-        return value;
+    if (Agsym_t *symbol = _scene->attributeSymbol(AGNODE, key, false))
+        return agxget(_node->node(), symbol);
     return QString();
 }
 
@@ -149,49 +154,63 @@ void QGVNode::setIcon(const QImage &icon)
 }
 
 void QGVNode::updateLayout()
+{
+    updateLayout(QGVLayoutData::nodeLayout(_node->node(), GD_bb(_scene->_graph->graph())));
+}
+
+void QGVNode::updateLayout(const QGVNodeLayout &layout)
 {
     prepareGeometryChange();
-    qreal width = ND_width(_node->node())*DotDefaultDPI;
-    qreal height = ND_height(_node->node())*DotDefaultDPI;
 
-    //Node Position (center)
-    qreal gheight = QGVCore::graphHeight(_scene->_graph->graph());
-    setPos(QGVCore::centerToOrigin(QGVCore::toPoint(ND_coord(_node->node()), gheight), width, height));
+    setPos(layout.pos);
 
     //Node on top
     setZValue(1);
 
-    //Node path
-    _path = QGVCore::toPath(ND_shape(_node->node())->name, (polygon_t*)ND_shape_info(_node->node()), width, height);
-    _pen.setWidth(1);
+    _path = layout.path;
+
+    updateRenderState();
+
+    if (!_icon.isNull())
+    {
+        const QRectF rect = _path.boundingRect().adjusted(2,2,-2,-2);
+        const QSize size = rect.adjusted(0, rect.height()/3,0, 0).size().toSize();
+        _scaledIcon = _icon.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
 
-    _brush.setStyle(QGVCore::toBrushStyle(getAttribute("style")));
-    _brush.setColor(QGVCore::toColor(getAttribute("fillcolor")));
-    _pen.setColor(QGVCore::toColor(getAttribute("color")));
+    if (_icon.isNull() && !_label.isEmpty())
+    {
+        textItem_->setText(_label);
+        textItem_->setCenter(_path.boundingRect().center());
+    }
+}
 
-    setToolTip(getAttribute("tooltip"));
+void QGVNode::updateRenderState()
+{
+    const QString style = getAttribute(QGVAttributeKey::Style);
 
-    auto l = label();
+    _invisible = QGVCore::isInvisible(style);
 
-    if (_icon.isNull() && !l.isEmpty())
+    const qreal width = QGVCore::toPenWidth(getAttribute(QGVAttributeKey::PenWidth));
+    if (width != _pen.widthF())
     {
-        auto topt = textItem_->document()->defaultTextOption();
-        topt.setAlignment(Qt::AlignCenter);
-        topt.setWrapMode(QTextOption::NoWrap);
-        textItem_->document()->setDefaultTextOption(topt);
-        textItem_->setHtml(l);
-
-        textItem_->adjustSize();
-
-        textItem_->setPos(0, 0);
-        auto itemRect = textItem_->boundingRect();
-        auto nodeCenter = textItem_->mapFromParent(boundingRect().center());
-        itemRect.moveCenter(nodeCenter);
-        //qDebug() << this << "node pos=" << pos() << "textItem pos=" << textItem_->pos();
-        //qDebug() << this << "node rect=" << boundingRect() << ", textItem rect=" << textItem_->boundingRect();
-        textItem_->setPos(itemRect.topLeft());
-        textItem_->show();
+        prepareGeometryChange();
+        _pen.setWidthF(width);
     }
-    else
-        textItem_->hide();
+    _pen.setColor(QGVCore::toColor(getAttribute(QGVAttributeKey::Color)));
+
+    _brush.setStyle(QGVCore::toBrushStyle(style));
+    _brush.setColor(QGVCore::toColor(getAttribute(QGVAttributeKey::FillColor)));
+    _selectedBrush = _brush;
+    _selectedBrush.setColor(_brush.color().darker(120));
+    _lowDetailColor = _brush.style() == Qt::NoBrush ? _pen.color() : _brush.color();
+
+    _fontColor = QGVCore::toColor(getAttribute(QGVAttributeKey::LabelFontColor));
+    _label = label();
+
+    setToolTip(getAttribute(QGVAttributeKey::Tooltip));
+
+    textItem_->setColor(QGVCore::toColor(getAttribute(QGVAttributeKey::FontColor)));
+    textItem_->setVisible(!_invisible && _icon.isNull() && !_label.isEmpty());
+    update();
 }
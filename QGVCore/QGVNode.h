@@ -19,13 +19,15 @@ License along with this library.
 #define QGVNODE_H
 
 #include "qgv_export.h"
+#include "QGVAttribute.h"
 #include <QGraphicsItem>
 #include <QPen>
 
 class QGVEdge;
 class QGVScene;
 class QGVNodePrivate;
-class QGraphicsTextItem;
+struct QGVNodeLayout;
+class QGVLabelItem;
 
 /**
  * @brief Node item
@@ -45,6 +47,9 @@ public:
     void paint(QPainter * painter, const QStyleOptionGraphicsItem * option, QWidget * widget = 0);
     void setAttribute(const QString &label, const QString &value);
     QString getAttribute(const QString &name) const;
+    // Same as above through the scene's cached attribute symbols
+    void setAttribute(const QGVAttributeKey &key, const QString &value);
+    QString getAttribute(const QGVAttributeKey &key) const;
 
     void setIcon(const QImage &icon);
 
@@ -58,6 +63,9 @@ private:
     friend class QGVScene;
     friend class QGVSubGraph;
     void updateLayout();
+    void updateLayout(const QGVNodeLayout &layout);
+    // Caches everything paint() needs from the cgraph attributes
+    void updateRenderState();
     QGVNode(QGVNodePrivate* node, QGVScene *scene);
 
 		// Not implemented in QGVNode.cpp
@@ -67,12 +75,18 @@ private:
     QPainterPath _path;
     QPen _pen;
     QBrush _brush;
+    QBrush _selectedBrush;
+    QColor _fontColor;
+    QColor _lowDetailColor;
+    QString _label;
+    bool _invisible = false;
     QImage _icon;
+    QImage _scaledIcon;
 
     QGVScene *_scene;
     QGVNodePrivate* _node;
 
-    QGraphicsTextItem *textItem_ = nullptr;
+    QGVLabelItem *textItem_ = nullptr;
 };
 
 
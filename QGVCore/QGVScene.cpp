@@ -17,264 +17,1813 @@ License along with this library.
 ***************************************************************/
 #include "QGVScene.h"
 
-#include <cstdio>
-#include <iostream>
 #include <QDebug>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QGVAttribute.h>
 #include <QGraphicsSceneContextMenuEvent>
+#include <QLoggingCategory>
+#include <QGVBulkItem.h>
 #include <QGVCore.h>
 #include <QGVEdge.h>
 #include <QGVEdgePrivate.h>
 #include <QGVGraphPrivate.h>
 #include <QGVGvcPrivate.h>
+#include <QGVItemIndex.h>
+#include <QGVLayoutCache.h>
+#include <QGVLabelItem.h>
+#include <QGVLayoutData.h>
+#include <QGVLayoutService.h>
 #include <QGVNode.h>
 #include <QGVNodePrivate.h>
+#include <QGVPrivatePools.h>
 #include <QGVSubGraph.h>
+#include <QMutexLocker>
 #include <QPainter>
+#include <QSet>
+#include <QTimer>
 #include <QVarLengthArray>
+#include <QtConcurrent>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+
+Q_LOGGING_CATEGORY(qgvStats, "qgv.stats", QtWarningMsg)
+
+namespace
+{
+const QGVAttributeKey PosKey("pos");
+
+// Initial buffer for the DOT text of a sequential device
+const int SequentialBufferSize = 1024 * 1024;
+
+// Adds the time spent in its scope to total, does nothing if not enabled
+class PhaseTimer
+{
+public:
+    PhaseTimer(bool enabled, qint64 &total)
+        : _total(enabled ? &total : nullptr)
+    {
+        if (_total)
+            _timer.start();
+    }
+
+    ~PhaseTimer()
+    {
+        stop();
+    }
+
+    void stop()
+    {
+        if (_total)
+            *_total += _timer.nsecsElapsed();
+        _total = nullptr;
+    }
+
+private:
+    qint64 *_total;
+    QElapsedTimer _timer;
+};
+
+double to_ms(qint64 nsecs)
+{
+    return nsecs / 1e6;
+}
+
+bool is_not_graph_item(QGraphicsItem *item)
+{
+    return item->type() != QGVNode::Type && item->type() != QGVEdge::Type && item->type() != QGVSubGraph::Type;
+}
+
+void insert_preset_options(QMap<QString, QString> &options, QGVScene::LayoutEngine engine, QGVScene::LayoutPreset preset)
+{
+    if (preset == QGVScene::QualityPreset)
+        return;
+
+    const bool fast = preset == QGVScene::FastPreset;
+
+    if (engine == QGVScene::DotEngine)
+    {
+        // Bound the network simplex and crossing minimization passes, these
+        // dominate the dot run time on large graphs.
+        options.insert("nslimit", fast ? "0.5" : "2");
+        options.insert("nslimit1", fast ? "0.5" : "2");
+        options.insert("mclimit", fast ? "0.1" : "0.5");
+        options.insert("searchsize", fast ? "5" : "10");
+    }
+    else
+    {
+        options.insert("maxiter", fast ? "50" : "200");
+    }
+
+    if (fast)
+        options.insert("splines", "line");
+}
+
+void for_each_subgraph(Agraph_t *graph, const std::function<void (Agraph_t *)> &f)
+{
+    for (auto sg = agfstsubg(graph); sg; sg = agnxtsubg(sg))
+    {
+        f(sg);
+        for_each_subgraph(sg, f);
+    }
+}
+
+template <typename Pool>
+void add_pool_stats(QGVScene::AllocatorStats &stats, const Pool &pool)
+{
+    const auto poolStats = pool.stats();
+    stats.liveObjects += poolStats.live;
+    stats.slabs += poolStats.slabs;
+    stats.reservedBytes += poolStats.slabs * Pool::SlabBytes;
+    stats.allocations += poolStats.allocations;
+    stats.reusedSlots += poolStats.reused;
+    stats.slabAllocations += poolStats.slabAllocations;
+}
+}
 
 QGVScene::QGVScene(QObject *parent)
     : QGVScene("g", parent)
 {
 }
 
-QGVScene::QGVScene(const QString &name, QObject *parent) : QGraphicsScene(parent)
-{
-    _context = new QGVGvcPrivate(gvContext());
-    _graph = new QGVGraphPrivate(agopen(name.toLocal8Bit().data(), Agdirected, NULL));
-    //setGraphAttribute("fontname", QFont().family());
+QGVScene::QGVScene(const QString &name, QObject *parent)
+    : QGraphicsScene(parent)
+    , _labelCache(new QGVLabelCache)
+    , _itemIndex(new QGVItemIndex)
+    , _pools(new QGVPrivatePools)
+    , _budgetTimer(new QTimer(this))
+    , _layoutGeneration(new QAtomicInt(0))
+{
+    qRegisterMetaType<QGVScene::LayoutStats>();
+
+    _budgetTimer->setSingleShot(true);
+    connect(_budgetTimer, &QTimer::timeout, this, &QGVScene::layoutBudgetExpired);
+
+    QMutexLocker locker(&QGVGvcPrivate::mutex());
+    _context = new QGVGvcPrivate(QGVGvcPrivate::acquireContext());
+    _graph = new QGVGraphPrivate(agopen(name.toLocal8Bit().data(), Agdirected, NULL));
+    //setGraphAttribute("fontname", QFont().family());
+}
+
+QGVScene::~QGVScene()
+{
+    // The items return their private objects to the pools, delete them
+    // before the pools. This also covers the handles of the bulk rendering
+    // mode, which are not owned by QGraphicsScene.
+    clearGraphItems();
+
+    supersedeLayouts();
+    QMutexLocker locker(&QGVGvcPrivate::mutex());
+    gvFreeLayout(_context->context(), _graph->graph());
+    agclose(_graph->graph());
+    QGVGvcPrivate::releaseContext();
+    delete _graph;
+    delete _context;
+    delete _labelCache;
+    delete _itemIndex;
+    delete _pools;
+}
+
+void QGVScene::setGraphAttribute(const QString &name, const QString &value)
+{
+    agattr(_graph->graph(), AGRAPH, name.toLocal8Bit().data(), value.toLocal8Bit().data());
+    defaultAttributeChanged(AGRAPH, name);
+}
+
+void QGVScene::setNodeAttribute(const QString &name, const QString &value)
+{
+    agattr(_graph->graph(), AGNODE, name.toLocal8Bit().data(), value.toLocal8Bit().data());
+    defaultAttributeChanged(AGNODE, name);
+}
+
+void QGVScene::setEdgeAttribute(const QString &name, const QString &value)
+{
+    agattr(_graph->graph(), AGEDGE, name.toLocal8Bit().data(), value.toLocal8Bit().data());
+    defaultAttributeChanged(AGEDGE, name);
+}
+
+void QGVScene::attributeChanged(QGraphicsItem *item, const QGVAttributeKey &key)
+{
+    const int effect = QGVCore::attributeEffect(key);
+
+    if (effect & QGVCore::LayoutEffect)
+        markLayoutDirty();
+    markDirty(item, effect);
+}
+
+void QGVScene::defaultAttributeChanged(int kind, const QString &name)
+{
+    const int effect = QGVCore::attributeEffect(QGVAttributeKey(name.toLocal8Bit()));
+
+    if (effect & QGVCore::LayoutEffect)
+        markLayoutDirty();
+
+    if (!(effect & QGVCore::StyleEffect) || !_hasLayout)
+        return;
+
+    // Objects without a value of their own pick up the new default
+    if (kind == AGNODE)
+    {
+        for (auto node: _nodes)
+            markDirty(node, QGVCore::StyleEffect);
+    }
+    else if (kind == AGEDGE)
+    {
+        for (auto edge: _edges)
+            markDirty(edge, QGVCore::StyleEffect);
+    }
+    else
+    {
+        for (auto subgraph: _subGraphs)
+            markDirty(subgraph, QGVCore::StyleEffect);
+    }
+
+    if (!_bulkItem)
+        return;
+
+    // The bulk item draws the objects without items
+    Agraph_t *graph = _graph->graph();
+
+    if (kind == AGNODE)
+    {
+        for (Agnode_t *node = agfstnode(graph); node; node = agnxtnode(graph, node))
+            _bulkItem->updateStyle(node);
+    }
+    else if (kind == AGEDGE)
+    {
+        for (Agnode_t *node = agfstnode(graph); node; node = agnxtnode(graph, node))
+        {
+            for (Agedge_t *edge = agfstout(graph, node); edge; edge = agnxtout(graph, edge))
+                _bulkItem->updateStyle(edge);
+        }
+    }
+    else
+    {
+        for_each_subgraph(graph, [this] (Agraph_t *subgraph)
+        {
+            _bulkItem->updateStyle(subgraph);
+        });
+    }
+}
+
+void QGVScene::markDirty(QGraphicsItem *item, int flags)
+{
+    // Laying the items out refreshes them anyway
+    if (!item || !flags || !_hasLayout)
+        return;
+
+    _dirtyItems[item] |= flags;
+    scheduleDirtyItems();
+}
+
+void QGVScene::markLayoutDirty()
+{
+    _layoutDirty = true;
+    scheduleDirtyItems();
+}
+
+void QGVScene::clearLayoutDirty()
+{
+    _layoutDirty = false;
+
+    for (auto it = _dirtyItems.begin(); it != _dirtyItems.end(); )
+    {
+        it.value() &= ~QGVCore::LayoutEffect;
+        it = it.value() ? std::next(it) : _dirtyItems.erase(it);
+    }
+}
+
+void QGVScene::scheduleDirtyItems()
+{
+    if (_dirtyItemsScheduled)
+        return;
+
+    _dirtyItemsScheduled = true;
+    QTimer::singleShot(0, this, [this] ()
+    {
+        processDirtyItems();
+    });
+}
+
+void QGVScene::processDirtyItems()
+{
+    _dirtyItemsScheduled = false;
+
+    for (auto it = _dirtyItems.begin(); it != _dirtyItems.end(); )
+    {
+        if (it.value() & QGVCore::StyleEffect)
+        {
+            QGraphicsItem *item = it.key();
+
+            if (auto node = qgraphicsitem_cast<QGVNode *>(item))
+            {
+                node->updateRenderState();
+                if (_bulkItem)
+                    _bulkItem->updateStyle(node->_node->node());
+            }
+            else if (auto edge = qgraphicsitem_cast<QGVEdge *>(item))
+            {
+                edge->updateRenderState();
+                if (_bulkItem)
+                    _bulkItem->updateStyle(edge->_edge->edge());
+            }
+            else if (auto subgraph = qgraphicsitem_cast<QGVSubGraph *>(item))
+            {
+                subgraph->updateRenderState();
+                if (_bulkItem)
+                    _bulkItem->updateStyle(subgraph->_sgraph->graph());
+            }
+        }
+
+        // Layout flags are kept until the next layout is requested
+        it.value() &= ~QGVCore::StyleEffect;
+        it = it.value() ? std::next(it) : _dirtyItems.erase(it);
+    }
+
+    if (_layoutDirty && _autoRelayout && _hasLayout)
+        applyLayout();
+}
+
+QGVNode *QGVScene::addNode(const QString &label, const QString &id)
+{
+    Agnode_t *node{};
+
+    if (!id.isEmpty())
+        node = agnode(_graph->graph(), id.toLocal8Bit().data(), true);
+    else
+        node = agnode(_graph->graph(), NULL, true);
+
+    if(node == NULL)
+    {
+        qWarning()<<"Invalid node :"<<label;
+        return 0;
+    }
+    QGVNode *item = new QGVNode(_pools->nodes.create(node, _graph->graph()), this);
+    setItemLabel(item, label);
+    addGraphItem(item);
+    registerNode(node, item);
+    markDirty(item, QGVCore::LayoutEffect);
+    markLayoutDirty();
+    return item;
+}
+
+QGVEdge *QGVScene::addEdge(QGVNode *source, QGVNode *target, const QString &label)
+{
+    Agedge_t* edge = agedge(_graph->graph(), source->_node->node(), target->_node->node(), NULL, true);
+    if(edge == NULL)
+    {
+        qWarning()<<"Invalid egde :"<<label;
+        return 0;
+    }
+
+    QGVEdge *item = new QGVEdge(_pools->edges.create(edge), this);
+    setItemLabel(item, label);
+    addGraphItem(item);
+    _edges.insert(edge, item);
+    markDirty(item, QGVCore::LayoutEffect);
+    markLayoutDirty();
+    return item;
+}
+
+QGVSubGraph *QGVScene::addSubGraph(const QString &name, bool cluster)
+{
+    Agraph_t* sgraph;
+    if(cluster)
+        sgraph = agsubg(_graph->graph(), ("cluster_" + name).toLocal8Bit().data(), true);
+    else
+        sgraph = agsubg(_graph->graph(), name.toLocal8Bit().data(), true);
+
+    if(sgraph == NULL)
+    {
+        qWarning()<<"Invalid subGraph :"<<name;
+        return 0;
+    }
+
+    QGVSubGraph *item = new QGVSubGraph(_pools->graphs.create(sgraph), this);
+    addGraphItem(item);
+    registerSubGraph(sgraph, item);
+    markDirty(item, QGVCore::LayoutEffect);
+    markLayoutDirty();
+    return item;
+}
+
+void QGVScene::deleteNode(QGVNode* node)
+{
+    if (_nodes.value(node->_node->node()) != node)
+        return;
+
+    deleteNode(node->_node->node());
+}
+
+void QGVScene::deleteEdge(QGVEdge* edge)
+{
+    if (_edges.value(edge->_edge->edge()) != edge)
+        return;
+
+    deleteEdge(edge->_edge->edge());
+}
+
+void QGVScene::deleteSubGraph(QGVSubGraph *subgraph)
+{
+    if (_subGraphs.value(subgraph->_sgraph->graph()) != subgraph)
+        return;
+
+    deleteSubGraph(subgraph->_sgraph->graph());
+}
+
+void QGVScene::deleteItems(const QList<QGraphicsItem *> &items)
+{
+    // Resolve the cgraph objects up front: deleting a node or subgraph may
+    // delete other items of the list along with it.
+    QVector<Agedge_t *> edges;
+    QVector<Agnode_t *> nodes;
+    QVector<Agraph_t *> subGraphs;
+
+    for (auto item: items)
+    {
+        if (auto edge = qgraphicsitem_cast<QGVEdge *>(item))
+            edges.append(edge->_edge->edge());
+        else if (auto node = qgraphicsitem_cast<QGVNode *>(item))
+            nodes.append(node->_node->node());
+        else if (auto subgraph = qgraphicsitem_cast<QGVSubGraph *>(item))
+            subGraphs.append(subgraph->_sgraph->graph());
+    }
+
+    for (auto edge: edges)
+    {
+        if (_edges.contains(edge))
+            deleteEdge(edge);
+    }
+
+    for (auto node: nodes)
+    {
+        if (_nodes.contains(node))
+            deleteNode(node);
+    }
+
+    for (auto subgraph: subGraphs)
+    {
+        if (_subGraphs.contains(subgraph))
+            deleteSubGraph(subgraph);
+    }
+}
+
+void QGVScene::destroyItem(QGraphicsItem *item)
+{
+    invalidateItemIndex();
+    markLayoutDirty();
+    _dirtyItems.remove(item);
+    if (_updateDepth)
+    {
+        auto pending = _pendingItemIndex.find(item);
+        if (pending != _pendingItemIndex.end())
+        {
+            _pendingItems[pending.value()] = nullptr;
+            _pendingItemIndex.erase(pending);
+        }
+    }
+    delete item;
+}
+
+void QGVScene::deleteNode(Agnode_t *node)
+{
+    Agraph_t *graph = _graph->graph();
+
+    // agdelnode() frees the incident edges as well. In-edges are returned as
+    // in-halves, the items are registered with the out-half.
+    for (Agedge_t *edge = agfstedge(graph, node); edge; edge = agnxtedge(graph, edge, node))
+    {
+        if (auto item = _edges.take(AGMKOUT(edge)))
+            destroyItem(item);
+        if (_bulkItem)
+            _bulkItem->remove(AGMKOUT(edge));
+    }
+
+    if (_bulkItem)
+        _bulkItem->remove(node);
+
+    destroyItem(unregisterNode(node));
+    agdelnode(graph, node);
+}
+
+void QGVScene::deleteEdge(Agedge_t *edge)
+{
+    if (_bulkItem)
+        _bulkItem->remove(edge);
+
+    destroyItem(_edges.take(edge));
+    agdeledge(_graph->graph(), edge);
+}
+
+void QGVScene::deleteSubGraph(Agraph_t *subgraph)
+{
+    // agclose() on a subgraph closes all subgraphs nested in it.
+    forgetSubGraphs(subgraph);
+    if (_bulkItem)
+        _bulkItem->remove(subgraph);
+    destroyItem(unregisterSubGraph(subgraph));
+    agclose(subgraph);
+}
+
+void QGVScene::forgetSubGraphs(Agraph_t *parent)
+{
+    for (auto sg = agfstsubg(parent); sg; sg = agnxtsubg(sg))
+    {
+        forgetSubGraphs(sg);
+
+        if (_bulkItem)
+            _bulkItem->remove(sg);
+
+        if (auto item = unregisterSubGraph(sg))
+            destroyItem(item);
+    }
+}
+
+void QGVScene::registerNode(Agnode_t *node, QGVNode *item)
+{
+    _nodes.insert(node, item);
+    _nodesByName.insert(QGVCore::nameOf(node), item);
+}
+
+void QGVScene::registerSubGraph(Agraph_t *subgraph, QGVSubGraph *item)
+{
+    _subGraphs.insert(subgraph, item);
+    _subGraphsByName.insert(QGVCore::nameOf(subgraph), item);
+}
+
+QGVNode *QGVScene::unregisterNode(Agnode_t *node)
+{
+    _nodesByName.remove(QGVCore::nameOf(node));
+    return _nodes.take(node);
+}
+
+QGVSubGraph *QGVScene::unregisterSubGraph(Agraph_t *subgraph)
+{
+    _subGraphsByName.remove(QGVCore::nameOf(subgraph));
+    return _subGraphs.take(subgraph);
+}
+
+QGVNode *QGVScene::findNode(const QString &name) const
+{
+    QByteArray id = name.toLocal8Bit();
+
+    if (auto item = _nodesByName.value(id))
+        return item;
+
+    // In bulk rendering mode items are created on demand.
+    if (_bulkRendering)
+    {
+        if (Agnode_t *node = agnode(_graph->graph(), id.data(), false))
+            return const_cast<QGVScene *>(this)->nodeHandle(node);
+    }
+
+    return nullptr;
+}
+
+QGVEdge *QGVScene::findEdge(const QString &tail, const QString &head, const QString &key) const
+{
+    auto tailItem = findNode(tail);
+    auto headItem = findNode(head);
+
+    if (!tailItem || !headItem)
+        return nullptr;
+
+    // cgraph indexes the edges of a node by their opposite end, the edge
+    // item is then found through the object hash. agedge() returns the
+    // in-half, the items are registered with the out-half.
+    Agedge_t *edge = agedge(_graph->graph(), tailItem->_node->node(), headItem->_node->node(),
+                            key.isEmpty() ? nullptr : key.toLocal8Bit().data(), false);
+
+    if (!edge)
+        return nullptr;
+
+    edge = AGMKOUT(edge);
+
+    if (auto item = _edges.value(edge))
+        return item;
+
+    return _bulkRendering ? const_cast<QGVScene *>(this)->edgeHandle(edge) : nullptr;
+}
+
+QGVSubGraph *QGVScene::findSubGraph(const QString &name) const
+{
+    QByteArray id = name.toLocal8Bit();
+
+    if (auto item = _subGraphsByName.value(id))
+        return item;
+
+    if (_bulkRendering)
+    {
+        if (Agraph_t *subgraph = agsubg(_graph->graph(), id.data(), false))
+            return const_cast<QGVScene *>(this)->subGraphHandle(subgraph);
+    }
+
+    return nullptr;
+}
+
+QGVNode *QGVScene::nodeHandle(Agnode_t *node)
+{
+    if (auto item = _nodes.value(node))
+        return item;
+
+    auto item = new QGVNode(_pools->nodes.create(node, _graph->graph()), this);
+    registerNode(node, item);
+    return item;
+}
+
+QGVEdge *QGVScene::edgeHandle(Agedge_t *edge)
+{
+    if (auto item = _edges.value(edge))
+        return item;
+
+    auto item = new QGVEdge(_pools->edges.create(edge), this);
+    _edges.insert(edge, item);
+    return item;
+}
+
+QGVSubGraph *QGVScene::subGraphHandle(Agraph_t *subgraph)
+{
+    if (auto item = _subGraphs.value(subgraph))
+        return item;
+
+    auto item = new QGVSubGraph(_pools->graphs.create(subgraph), this);
+    registerSubGraph(subgraph, item);
+    return item;
+}
+
+QGraphicsItem *QGVScene::bulkItemAt(const QPointF &pos)
+{
+    if (auto node = _bulkItem->nodeAt(pos))
+        return nodeHandle(node);
+
+    if (auto edge = _bulkItem->edgeAt(pos))
+        return edgeHandle(edge);
+
+    if (auto subgraph = _bulkItem->subGraphAt(pos))
+        return subGraphHandle(subgraph);
+
+    return nullptr;
+}
+
+void QGVScene::setBulkRendering(bool bulk)
+{
+    if (bulk == _bulkRendering)
+        return;
+
+    clearGraphItems();
+
+    if (_bulkItem)
+    {
+        removeItem(_bulkItem);
+        delete _bulkItem;
+        _bulkItem = nullptr;
+    }
+
+    _bulkRendering = bulk;
+
+    if (agnnodes(_graph->graph()) > 0)
+        createGraphItems();
+}
+
+QGVScene::AllocatorStats QGVScene::allocatorStats() const
+{
+    AllocatorStats result;
+    add_pool_stats(result, _pools->nodes);
+    add_pool_stats(result, _pools->edges);
+    add_pool_stats(result, _pools->graphs);
+    return result;
+}
+
+void QGVScene::setRootNode(QGVNode *node)
+{
+    Q_ASSERT(_nodes.value(node->_node->node()) == node);
+    char root[] = "root";
+    agset(_graph->graph(), root, node->label().toLocal8Bit().data());
+}
+
+void QGVScene::beginUpdate(int expectedNodes, int expectedEdges)
+{
+    if (_updateDepth++ > 0)
+        return;
+
+    _nodes.reserve(_nodes.size() + expectedNodes);
+    _nodesByName.reserve(_nodesByName.size() + expectedNodes);
+    _edges.reserve(_edges.size() + expectedEdges);
+    _pendingItems.reserve(expectedNodes + expectedEdges);
+    _pendingItemIndex.reserve(expectedNodes + expectedEdges);
+}
+
+void QGVScene::endUpdate()
+{
+    Q_ASSERT(_updateDepth > 0);
+
+    if (--_updateDepth > 0)
+        return;
+
+    // Insert without maintaining the BSP tree, it is rebuilt in one go when
+    // the index method is restored.
+    {
+        PhaseTimer timer(_statsRunning, _stats.itemCreationTime);
+        const auto indexMethod = itemIndexMethod();
+        setItemIndexMethod(QGraphicsScene::NoIndex);
+
+        for (auto item: _pendingItems)
+        {
+            if (item)
+                addItem(item);
+        }
+
+        _pendingItems.clear();
+        _pendingItems.squeeze();
+        _pendingItemIndex.clear();
+        _pendingItemIndex.squeeze();
+        setItemIndexMethod(indexMethod);
+    }
+
+    if (_layoutPending)
+    {
+        _layoutPending = false;
+        applyLayout();
+    }
+}
+
+void QGVScene::addGraphItem(QGraphicsItem *item)
+{
+    // The bulk item draws everything, items only serve as handles.
+    if (_bulkRendering)
+        return;
+
+    if (_updateDepth)
+    {
+        _pendingItemIndex.insert(item, _pendingItems.size());
+        _pendingItems.append(item);
+    }
+    else
+    {
+        addItem(item);
+    }
+
+    invalidateItemIndex();
+}
+
+void QGVScene::setItemIndex(ItemIndex index)
+{
+    _itemIndexType = index;
+    _itemIndex->clear();
+    _itemIndexDirty = true;
+}
+
+void QGVScene::rebuildItemIndex()
+{
+    QList<QGraphicsItem *> items;
+    items.reserve(_subGraphs.size() + _edges.size() + _nodes.size());
+
+    // Roughly the order the items were added in, see QGVItemIndex::sorted().
+    // Items of a running batch are not part of the scene yet.
+    for (auto sg: _subGraphs)
+    {
+        if (sg->scene() == this)
+            items.append(sg);
+    }
+    for (auto edge: _edges)
+    {
+        if (edge->scene() == this)
+            items.append(edge);
+    }
+    for (auto node: _nodes)
+    {
+        if (node->scene() == this)
+            items.append(node);
+    }
+
+    _itemIndex->build(items);
+    _itemIndexDirty = false;
+}
+
+QList<QGraphicsItem *> QGVScene::graphItemsAt(const QPointF &pos)
+{
+    if (_bulkRendering)
+    {
+        QGraphicsItem *item = _bulkItem ? bulkItemAt(pos) : nullptr;
+        return item ? QList<QGraphicsItem *>{ item } : QList<QGraphicsItem *>();
+    }
+
+    if (_itemIndexType == QtItemIndex)
+    {
+        QList<QGraphicsItem *> result = items(pos);
+        result.erase(std::remove_if(result.begin(), result.end(), is_not_graph_item), result.end());
+        return result;
+    }
+
+    if (_itemIndexDirty)
+        rebuildItemIndex();
+
+    return _itemIndex->items(pos);
+}
+
+QList<QGraphicsItem *> QGVScene::graphItemsIn(const QRectF &rect, Qt::ItemSelectionMode mode)
+{
+    if (_bulkRendering)
+        return {};
+
+    if (_itemIndexType == QtItemIndex)
+    {
+        QList<QGraphicsItem *> result = items(rect, mode);
+        result.erase(std::remove_if(result.begin(), result.end(), is_not_graph_item), result.end());
+        return result;
+    }
+
+    if (_itemIndexDirty)
+        rebuildItemIndex();
+
+    return _itemIndex->items(rect, mode);
+}
+
+void QGVScene::setItemLabel(QGVNode *node, const QString &label)
+{
+    // HTML labels need agstrdup_html(), leave them to setLabel().
+    if (!_updateDepth || label.startsWith('<'))
+    {
+        node->setLabel(label);
+        return;
+    }
+
+    // Within a batch skip the render state update, the items are laid out
+    // at the end of the batch anyway.
+    agxset(node->_node->node(), attributeSymbol(AGNODE, QGVAttributeKey::Label, true), label.toLocal8Bit().data());
+}
+
+void QGVScene::setItemLabel(QGVEdge *edge, const QString &label)
+{
+    if (!_updateDepth)
+    {
+        edge->setLabel(label);
+        return;
+    }
+
+    agxset(edge->_edge->edge(), attributeSymbol(AGEDGE, QGVAttributeKey::Label, true), label.toLocal8Bit().data());
+}
+
+Agsym_t *QGVScene::attributeSymbol(int kind, const QGVAttributeKey &key, bool declare)
+{
+    auto &symbols = _attributeSymbols[kind];
+
+    if (key.id() < symbols.size() && symbols[key.id()])
+        return symbols[key.id()];
+
+    QByteArray name = key.name();
+    Agsym_t *symbol = agattr(_graph->graph(), kind, name.data(), NULL);
+
+    if (!symbol && declare)
+    {
+        char empty[] = "";
+        symbol = agattr(_graph->graph(), kind, name.data(), empty);
+    }
+
+    // Undeclared attributes are not cached, they may be declared by name
+    // later on.
+    if (symbol)
+    {
+        if (key.id() >= symbols.size())
+            symbols.resize(key.id() + 1);
+        symbols[key.id()] = symbol;
+    }
+
+    return symbol;
+}
+
+Agraph_t *QGVScene::graph()
+{
+    return _graph->graph();
+}
+
+QString QGVScene::toDot() const
+{
+    return QString::fromLocal8Bit(toDotBytes());
+}
+
+QByteArray QGVScene::toDotBytes() const
+{
+    QByteArray result;
+    result.reserve(4096);
+
+    QMutexLocker locker(&QGVGvcPrivate::mutex());
+
+    if (!QGVCore::agmemwrite(_graph->graph(), &result))
+        return {};
+
+    return result;
+}
+
+bool QGVScene::toDot(QIODevice *device) const
+{
+    QMutexLocker locker(&QGVGvcPrivate::mutex());
+    return QGVCore::agdevwrite(_graph->graph(), device);
+}
+
+void QGVScene::newGraph(const QString &name)
+{
+    // Drops the record of a layout that will not finish anymore
+    _statsRunning = false;
+    _fallbackLevel = 0;
+    clearGraphItems();
+    agclose(_graph->graph());
+    _graph->setGraph(agopen(name.toLocal8Bit().data(), Agdirected, NULL));
+}
+
+void QGVScene::loadLayout(const QString &text)
+{
+    beginStats();
+    const QByteArray data = text.toLocal8Bit();
+    Agraph_t *graph = nullptr;
+
+    {
+        PhaseTimer timer(_statsRunning, _stats.parseTime);
+        QMutexLocker locker(&QGVGvcPrivate::mutex());
+        graph = QGVCore::agmemread2(data.constData(), data.size());
+    }
+
+    if (_statsRunning)
+        _stats.bytesParsed = data.size();
+
+    loadGraph(graph);
+}
+
+bool QGVScene::loadLayout(QIODevice *device)
+{
+    beginStats();
+    Agraph_t *graph = nullptr;
+    const qint64 start = device->pos();
+
+    // Sockets and pipes may take a while to deliver the graph. Buffer them
+    // before taking the Graphviz lock, which blocks all layouts.
+    if (device->isSequential())
+    {
+        QByteArray data;
+        data.reserve(int(qMax<qint64>(device->bytesAvailable(), SequentialBufferSize)));
+
+        for (;;)
+        {
+            const qint64 available = device->bytesAvailable();
+
+            if (available > 0)
+            {
+                const int size = data.size();
+
+                if (data.capacity() < size + available)
+                    data.reserve(int(qMax<qint64>(2 * qint64(data.capacity()), size + available)));
+
+                data.resize(int(size + available));
+                const qint64 read = device->read(data.data() + size, available);
+                data.resize(size + int(qMax<qint64>(read, 0)));
+
+                if (read > 0)
+                    continue;
+            }
+
+            // Returns right away once the device is closed or at its end
+            QElapsedTimer wait;
+            wait.start();
+
+            if (device->waitForReadyRead(QGVCore::DeviceReadTimeout))
+                continue;
+
+            if (wait.elapsed() >= QGVCore::DeviceReadTimeout)
+            {
+                qWarning() << "Timed out reading graph from" << device;
+                finishStats();
+                return false;
+            }
+
+            break;
+        }
+
+        {
+            PhaseTimer timer(_statsRunning, _stats.parseTime);
+            QMutexLocker locker(&QGVGvcPrivate::mutex());
+            graph = QGVCore::agmemread2(data.constData(), data.size());
+        }
+
+        if (_statsRunning)
+            _stats.bytesParsed = data.size();
+
+        return loadGraph(graph);
+    }
+
+    {
+        PhaseTimer timer(_statsRunning, _stats.parseTime);
+        QMutexLocker locker(&QGVGvcPrivate::mutex());
+        graph = QGVCore::agdevread(device);
+    }
+
+    if (_statsRunning)
+        _stats.bytesParsed = device->pos() - start;
+
+    return loadGraph(graph);
+}
+
+bool QGVScene::loadLayoutFromFile(const QString &path)
+{
+    QFile file(path);
+
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "Could not open" << path << file.errorString();
+        return false;
+    }
+
+    beginStats();
+    Agraph_t *graph = nullptr;
+    const qint64 size = file.size();
+    PhaseTimer timer(_statsRunning, _stats.parseTime);
+
+    if (_statsRunning)
+        _stats.bytesParsed = size;
+
+    // Parse straight from the page cache if the file can be mapped, read it
+    // in blocks otherwise.
+    if (uchar *data = size > 0 ? file.map(0, size) : nullptr)
+    {
+        {
+            QMutexLocker locker(&QGVGvcPrivate::mutex());
+            graph = QGVCore::agmemread2(reinterpret_cast<const char *>(data), size);
+        }
+        file.unmap(data);
+    }
+    else
+    {
+        QMutexLocker locker(&QGVGvcPrivate::mutex());
+        graph = QGVCore::agdevread(&file);
+    }
+
+    timer.stop();
+    return loadGraph(graph);
+}
+
+bool QGVScene::loadGraph(Agraph_t *graph)
+{
+    if (!graph)
+    {
+        qWarning() << "Could not parse graph" << agerrors() << QString::fromLocal8Bit(aglasterr());
+        finishStats();
+        return false;
+    }
+
+    _fallbackLevel = 0;
+
+    if (_loadMode == ReuseItems && !_bulkRendering)
+    {
+        reuseGraphItems(graph);
+        return true;
+    }
+
+    clearGraphItems();
+    agclose(_graph->graph());
+    _graph->setGraph(graph);
+
+    createGraphItems();
+    return true;
+}
+
+void QGVScene::reuseGraphItems(Agraph_t *graph)
+{
+    beginStats();
+    supersedeLayouts();
+
+    invalidateItemIndex();
+
+    Agraph_t *previous = _graph->graph();
+    QHash<QByteArray, QGVEdge *> previousEdges;
+
+    // The scene graph never keeps a layout attached, see applyLayout().
+    previousEdges.reserve(_edges.size());
+    for (const auto &edge: QGVLayoutData::keyedEdges(previous, false))
+    {
+        if (auto item = _edges.value(edge.first))
+            previousEdges.insert(edge.second, item);
+    }
+
+    // The cached symbols belong to the previous graph. Set the new graph up
+    // front, the items read their attributes from it.
+    for (auto &symbols: _attributeSymbols)
+        symbols.clear();
+    _graph->setGraph(graph);
+
+    beginUpdate(agnnodes(graph), agnedges(graph));
+    PhaseTimer timer(_statsRunning, _stats.itemCreationTime);
+
+    quint64 reused = 0;
+
+    // Subgraphs, the immediate ones as in createGraphItems()
+    auto previousSubGraphs = _subGraphsByName;
+    _subGraphs.clear();
+    _subGraphsByName.clear();
+
+    for (auto sg = agfstsubg(graph); sg; sg = agnxtsubg(sg))
+    {
+        const QByteArray name = QGVCore::nameOf(sg);
+        QGVSubGraph *item = previousSubGraphs.take(name);
+
+        if (item)
+        {
+            item->_sgraph->setGraph(sg);
+            ++reused;
+        }
+        else
+        {
+            item = new QGVSubGraph(_pools->graphs.create(sg), this);
+            addGraphItem(item);
+            markDirty(item, QGVCore::LayoutEffect);
+        }
+
+        _subGraphs.insert(sg, item);
+        _subGraphsByName.insert(name, item);
+    }
+
+    // Nodes and edges
+    auto previousNodes = _nodesByName;
+    _nodes.clear();
+    _nodesByName.clear();
+    _nodes.reserve(agnnodes(graph));
+    _nodesByName.reserve(agnnodes(graph));
+
+    for (Agnode_t* node = agfstnode(graph); node != NULL; node = agnxtnode(graph, node))
+    {
+        const QByteArray name = QGVCore::nameOf(node);
+        QGVNode *item = previousNodes.take(name);
+
+        if (item)
+        {
+            item->_node->setNode(node, graph);
+            ++reused;
+        }
+        else
+        {
+            item = new QGVNode(_pools->nodes.create(node, graph), this);
+            addGraphItem(item);
+            markDirty(item, QGVCore::LayoutEffect);
+        }
+
+        _nodes.insert(node, item);
+        _nodesByName.insert(name, item);
+    }
+
+    const auto edges = QGVLayoutData::keyedEdges(graph, false);
+
+    _edges.clear();
+    _edges.reserve(edges.size());
+
+    for (const auto &edge: edges)
+    {
+        QGVEdge *item = previousEdges.take(edge.second);
+
+        if (item)
+        {
+            item->_edge->setEdge(edge.first);
+            ++reused;
+        }
+        else
+        {
+            item = new QGVEdge(_pools->edges.create(edge.first), this);
+            item->setFlag(QGraphicsItem::ItemIsSelectable, false);
+            addGraphItem(item);
+            markDirty(item, QGVCore::LayoutEffect);
+        }
+
+        _edges.insert(edge.first, item);
+    }
+
+    // Objects missing from the new graph, edges first as in deleteNode()
+    for (auto item: previousEdges)
+        destroyItem(item);
+    for (auto item: previousNodes)
+        destroyItem(item);
+    for (auto item: previousSubGraphs)
+        destroyItem(item);
+
+    agclose(previous);
+
+    if (_statsRunning)
+        _stats.itemsReused += reused;
+
+    timer.stop();
+    applyLayout();
+    endUpdate();
+}
+
+void QGVScene::createGraphItems()
+{
+    //Debug output
+		//gvRenderFilename(_context->context(), _graph->graph(), "png", "debug.png");
+
+    beginStats();
+    beginUpdate(agnnodes(_graph->graph()), agnedges(_graph->graph()));
+    PhaseTimer timer(_statsRunning, _stats.itemCreationTime);
+
+    // Add subgraphs first to layer them below other items.
+    // Note: The loop only picks up the immediate subgraphs of the given graph.
+    // Recursion would be needed to find all subgraphs.
+    for (auto sg = agfstsubg(_graph->graph()); sg; sg = agnxtsubg(sg))
+    {
+        auto sgItem = new QGVSubGraph(_pools->graphs.create(sg), this);
+        addGraphItem(sgItem);
+        registerSubGraph(sg, sgItem);
+    }
+
+    //Read nodes and edges, created on demand in bulk rendering mode
+    if (!_bulkRendering)
+    {
+        for (Agnode_t* node = agfstnode(_graph->graph()); node != NULL; node = agnxtnode(_graph->graph(), node))
+        {
+            QGVNode *inode = new QGVNode(_pools->nodes.create(node, _graph->graph()), this);
+            //inode->updateLayout();
+            addGraphItem(inode);
+            registerNode(node, inode);
+            for (Agedge_t* edge = agfstout(_graph->graph(), node); edge != NULL; edge = agnxtout(_graph->graph(), edge))
+            {
+                QGVEdge *iedge = new QGVEdge(_pools->edges.create(edge), this);
+                iedge->setFlag(QGraphicsItem::ItemIsSelectable, false);
+                //iedge->updateLayout();
+                addGraphItem(iedge);
+                _edges.insert(edge, iedge);
+            }
+        }
+    }
+
+    timer.stop();
+    applyLayout();
+    endUpdate();
+}
+
+void QGVScene::applyLayout()
+{
+    if (_updateDepth)
+    {
+        _layoutPending = true;
+        return;
+    }
+
+    beginStats();
+
+    if (_asyncLayout || _layoutService)
+    {
+        applyLayoutAsync();
+        return;
+    }
+
+    supersedeLayouts();
+    emit layoutStarted();
+
+    const QGVLayoutRequest request = layoutRequest();
+    const auto previousPositions = seedStablePositions();
+    clearLayoutDirty();
+    QByteArray dot;
+    QByteArray cacheKey;
+
+    if (_layoutCache)
+    {
+        QGVLayoutData layout;
+        dot = toDotBytes();
+        cacheKey = QGVLayoutCache::key(dot, request.engine, request.optionsKey());
+
+        if (_layoutCache->find(cacheKey, &layout))
+        {
+            restoreStablePositions(previousPositions);
+            _stats.cacheHit = _statsRunning;
+            finishLayout(layout);
+            return;
+        }
+    }
+
+    QMutexLocker locker(&QGVGvcPrivate::mutex());
+
+    if (!QGVLayoutData::optionsDeclared(_graph->graph(), request.options))
+    {
+        // The options could not be restored on the scene graph, lay out a
+        // parsed copy like the asynchronous layouts do.
+        locker.unlock();
+        if (dot.isEmpty())
+            dot = toDotBytes();
+        restoreStablePositions(previousPositions);
+
+        const QGVLayoutData layout = QGVLayoutData::compute(dot, request);
+
+        if (layout.valid)
+        {
+            if (_layoutCache)
+                _layoutCache->insert(cacheKey, layout);
+            checkLayoutBudget(layout.layoutTime);
+        }
+        finishLayout(layout);
+        return;
+    }
+
+    // The options only apply to this layout, restore the scene attributes.
+    const auto previousOptions = QGVLayoutData::applyOptions(_graph->graph(), request.options);
+    PhaseTimer layoutTimer(_statsRunning, _stats.layoutTime);
+    QElapsedTimer budgetTimer;
+    budgetTimer.start();
+    const int status = gvLayout(_context->context(), _graph->graph(), request.engine.constData());
+    const qint64 layoutTime = budgetTimer.nsecsElapsed();
+    layoutTimer.stop();
+    QGVLayoutData::applyOptions(_graph->graph(), previousOptions);
+    restoreStablePositions(previousPositions);
+
+    if(status != 0)
+    {
+        /*
+         * Si plantage ici :
+         *  - Verifier que les dll sont dans le repertoire d'execution
+         *  - Verifie que le fichier "configN" est dans le repertoire d'execution !
+         */
+        qCritical()<<"Layout render error"<<request.engine<<agerrors()<<QString::fromLocal8Bit(aglasterr());
+        gvFreeLayout(_context->context(), _graph->graph());
+        locker.unlock();
+        emit layoutFinished(false);
+        finishStats();
+        return;
+    }
+
+    //Debug output
+		//gvRenderFilename(_context->context(), _graph->graph(), "canon", "debug.dot");
+		//gvRenderFilename(_context->context(), _graph->graph(), "png", "debug.png");
+
+    if (_layoutCache || _bulkRendering)
+    {
+        // The cache and the bulk item need the detached, name keyed layout
+        // anyway. Apply that instead of converting the layout a second time.
+        PhaseTimer conversionTimer(_statsRunning, _stats.conversionTime);
+        const QGVLayoutData layout = QGVLayoutData::fromGraph(_graph->graph());
+        conversionTimer.stop();
+        gvFreeLayout(_context->context(), _graph->graph());
+        locker.unlock();
+
+        if (_layoutCache)
+            _layoutCache->insert(cacheKey, layout);
+        checkLayoutBudget(layoutTime);
+        finishLayout(layout);
+        return;
+    }
+
+    locker.unlock();
+
+    checkLayoutBudget(layoutTime);
+    updateLayout();
+
+    locker.relock();
+    gvFreeLayout(_context->context(), _graph->graph());
+    locker.unlock();
+
+    {
+        PhaseTimer timer(_statsRunning, _stats.sceneRectTime);
+        setSceneRect(itemsBoundingRect());
+    }
+    update();
+    emit layoutFinished(true);
+    finishStats();
+}
+
+void QGVScene::applyLayoutAsync()
+{
+    beginStats();
+    const int generation = supersedeLayouts();
+    const QSharedPointer<QAtomicInt> currentGeneration = _layoutGeneration;
+    QGVLayoutRequest request = layoutRequest();
+    const auto previousPositions = seedStablePositions();
+    const QByteArray dot = toDotBytes();
+    QByteArray cacheKey;
+    restoreStablePositions(previousPositions);
+    clearLayoutDirty();
+
+    // A restart after running past the budget continues the started layout
+    if (!_asyncLayoutPending)
+        emit layoutStarted();
+
+    if (_layoutCache)
+    {
+        QGVLayoutData layout;
+        cacheKey = QGVLayoutCache::key(dot, request.engine, request.optionsKey());
+
+        if (_layoutCache->find(cacheKey, &layout))
+        {
+            _stats.cacheHit = _statsRunning;
+            finishLayout(layout);
+            return;
+        }
+    }
+
+    // Skips requests that got superseded while waiting in the pool or for
+    // the Graphviz lock, and the phases after the layout engine.
+    request.cancelled = [generation, currentGeneration] ()
+    {
+        return generation != currentGeneration->load();
+    };
+
+    _asyncLayoutPending = true;
+    if (_layoutTimeBudget > 0)
+        _budgetTimer->start(_layoutTimeBudget);
+
+    if (_layoutService && _layoutService->isAvailable())
+    {
+        _layoutServiceJob = _layoutService->submit(dot, request, _layoutServicePriority, -1, this,
+                                                   [this, cacheKey] (const QGVLayoutData &layout)
+        {
+            // Superseded jobs are cancelled and do not report back
+            _layoutServiceJob = 0;
+
+            if (_layoutCache && !cacheKey.isEmpty())
+                _layoutCache->insert(cacheKey, layout);
+
+            finishLayout(layout);
+        });
+        return;
+    }
+
+    auto watcher = new QFutureWatcher<QGVLayoutData>(this);
+
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation, cacheKey] ()
+    {
+        watcher->deleteLater();
+
+        if (generation != _layoutGeneration->load())
+            return;
+
+        const QGVLayoutData layout = watcher->result();
+
+        if (_layoutCache && !cacheKey.isEmpty())
+            _layoutCache->insert(cacheKey, layout);
+
+        finishLayout(layout);
+    });
+
+    watcher->setFuture(QtConcurrent::run([dot, request] ()
+    {
+        return QGVLayoutData::compute(dot, request);
+    }));
 }
 
-QGVScene::~QGVScene()
+void QGVScene::cancelLayout()
 {
-    gvFreeLayout(_context->context(), _graph->graph());
-    agclose(_graph->graph());
-    gvFreeContext(_context->context());
-    delete _graph;
-    delete _context;
+    supersedeLayouts();
+
+    // Drops the record of the cancelled layout
+    _statsRunning = false;
+
+    if (_asyncLayoutPending)
+    {
+        _asyncLayoutPending = false;
+        emit layoutFinished(false);
+    }
 }
 
-void QGVScene::setGraphAttribute(const QString &name, const QString &value)
+void QGVScene::layoutBudgetExpired()
 {
-    agattr(_graph->graph(), AGRAPH, name.toLocal8Bit().data(), value.toLocal8Bit().data());
+    if (!_asyncLayoutPending)
+        return;
+
+    emit layoutBudgetExceeded(_effectiveLayoutPreset, _effectiveLayoutEngine);
+
+    // Nothing cheaper to fall back to, let the layout finish
+    if (!_cheaperLayoutAvailable)
+        return;
+
+    ++_fallbackLevel;
+
+    // Only a worker process can be killed. In process the cheaper layout
+    // would wait for the Graphviz lock held by the running one, let that
+    // finish and use the fallback from the next layout on.
+    if (!_layoutServiceJob)
+        return;
+
+    applyLayoutAsync();
 }
 
-void QGVScene::setNodeAttribute(const QString &name, const QString &value)
+void QGVScene::checkLayoutBudget(qint64 layoutTime)
 {
-    agattr(_graph->graph(), AGNODE, name.toLocal8Bit().data(), value.toLocal8Bit().data());
+    if (_layoutTimeBudget <= 0 || layoutTime <= qint64(_layoutTimeBudget) * 1000000)
+        return;
+
+    if (_cheaperLayoutAvailable)
+        ++_fallbackLevel;
+
+    emit layoutBudgetExceeded(_effectiveLayoutPreset, _effectiveLayoutEngine);
 }
 
-void QGVScene::setEdgeAttribute(const QString &name, const QString &value)
+qint64 QGVScene::contextCreationTime()
 {
-    agattr(_graph->graph(), AGEDGE, name.toLocal8Bit().data(), value.toLocal8Bit().data());
+    return QGVGvcPrivate::contextCreationTime();
 }
 
-QGVNode *QGVScene::addNode(const QString &label, const QString &id)
+void QGVScene::setDetailThresholds(qreal labelThreshold, qreal edgeThreshold)
 {
-    Agnode_t *node{};
-
-    if (!id.isEmpty())
-        node = agnode(_graph->graph(), id.toLocal8Bit().data(), true);
-    else
-        node = agnode(_graph->graph(), NULL, true);
-
-    if(node == NULL)
-    {
-        qWarning()<<"Invalid node :"<<label;
-        return 0;
-    }
-    QGVNode *item = new QGVNode(new QGVNodePrivate(node, _graph->graph()), this);
-    item->setLabel(label);
-    addItem(item);
-    _nodes.append(item);
-    return item;
+    _labelDetailThreshold = labelThreshold;
+    _edgeDetailThreshold = edgeThreshold;
+    update();
 }
 
-QGVEdge *QGVScene::addEdge(QGVNode *source, QGVNode *target, const QString &label)
+void QGVScene::setHideLowDetailEdges(bool hide)
 {
-    Agedge_t* edge = agedge(_graph->graph(), source->_node->node(), target->_node->node(), NULL, true);
-    if(edge == NULL)
-    {
-        qWarning()<<"Invalid egde :"<<label;
-        return 0;
-    }
-
-    QGVEdge *item = new QGVEdge(new QGVEdgePrivate(edge), this);
-    item->setLabel(label);
-    addItem(item);
-    _edges.append(item);
-    return item;
+    _hideLowDetailEdges = hide;
+    update();
 }
 
-QGVSubGraph *QGVScene::addSubGraph(const QString &name, bool cluster)
+void QGVScene::setLayoutEngineOption(LayoutEngine engine, const QString &name, const QString &value)
 {
-    Agraph_t* sgraph;
-    if(cluster)
-        sgraph = agsubg(_graph->graph(), ("cluster_" + name).toLocal8Bit().data(), true);
+    if (value.isEmpty())
+        _layoutEngineOptions[engine].remove(name);
     else
-        sgraph = agsubg(_graph->graph(), name.toLocal8Bit().data(), true);
-
-    if(sgraph == NULL)
-    {
-        qWarning()<<"Invalid subGraph :"<<name;
-        return 0;
-    }
-
-    QGVSubGraph *item = new QGVSubGraph(new QGVGraphPrivate(sgraph), this);
-    addItem(item);
-    _subGraphs.append(item);
-    return item;
+        _layoutEngineOptions[engine].insert(name, value);
 }
 
-void QGVScene::deleteNode(QGVNode* node)
+void QGVScene::setLayoutPreset(LayoutPreset preset)
 {
-    QList<QGVNode *>::iterator it = std::find(_nodes.begin(), _nodes.end(), node);
-    if(it == _nodes.end())
-    {
-        std::cout << "Error, node not part of Scene" << std::endl;
-        return;
-    }
-    std::cout << "delNode ret " << agdelnode(node->_node->graph(), node->_node->node()) << std::endl;;
-    _nodes.erase(it);
-    delete node;
+    _layoutPreset = preset;
+    _fallbackLevel = 0;
 }
 
-void QGVScene::deleteEdge(QGVEdge* edge)
+void QGVScene::setLayoutTimeBudget(int msecs)
 {
-    std::cout << "delEdge ret " << agdeledge(_graph->graph(), edge->_edge->edge()) << std::endl;
-    QList<QGVEdge *>::iterator it = std::find(_edges.begin(), _edges.end(), edge);
-    if(it == _edges.end())
-    {
-        std::cout << "Error, QGVEdge not part of Scene" << std::endl;
-        return;
-    }
-    _edges.erase(it);
-    delete edge;
+    _layoutTimeBudget = qMax(0, msecs);
+    _fallbackLevel = 0;
 }
 
-void QGVScene::deleteSubGraph(QGVSubGraph *subgraph)
+QGVLayoutService *QGVScene::layoutService() const
 {
-    std::cout << "Removing sug " << subgraph->_sgraph->graph() << std::endl;
-    std::cout << "delSubg ret " << agclose(subgraph->_sgraph->graph()) << std::endl;
-    QList<QGVSubGraph *>::iterator it = std::find(_subGraphs.begin(), _subGraphs.end(), subgraph);
-    if(it == _subGraphs.end())
-    {
-        std::cout << "Error, QGVSubGraph not part of Scene" << std::endl;
-        return;
-    }
-    _subGraphs.erase(it);
-
-    delete subgraph;
+    return _layoutService;
 }
 
-void QGVScene::setRootNode(QGVNode *node)
+void QGVScene::setLayoutService(QGVLayoutService *service, int priority)
 {
-    Q_ASSERT(_nodes.contains(node));
-    char root[] = "root";
-    agset(_graph->graph(), root, node->label().toLocal8Bit().data());
+    _layoutService = service;
+    _layoutServicePriority = priority;
 }
 
-Agraph_t *QGVScene::graph()
+void QGVScene::setAutoLayoutPolicy(int elementThreshold, LayoutEngine largeGraphEngine)
 {
-    return _graph->graph();
+    _autoLayoutThreshold = elementThreshold;
+    _largeGraphEngine = largeGraphEngine == AutoEngine ? SfdpEngine : largeGraphEngine;
 }
 
-QString QGVScene::toDot() const
+QByteArray QGVScene::layoutEngineName(LayoutEngine engine)
 {
-    if (auto outfile = std::tmpfile())
+    switch (engine)
     {
-        agwrite(const_cast<QGVScene *>(this)->graph(), outfile);
-        auto bytesWritten = std::ftell(outfile);
-        std::rewind(outfile);
-        QByteArray data(bytesWritten, '\0');
-        std::fread(data.data(), bytesWritten, 1, outfile);
-        std::fclose(outfile);
-        return QString::fromLocal8Bit(data);
+        case NeatoEngine:
+            return "neato";
+        case FdpEngine:
+            return "fdp";
+        case SfdpEngine:
+            return "sfdp";
+        case TwopiEngine:
+            return "twopi";
+        case CircoEngine:
+            return "circo";
+        case DotEngine:
+        case AutoEngine:
+            break;
     }
-    return {};
+    return "dot";
 }
 
-void QGVScene::newGraph(const QString &name)
+bool QGVScene::isLargeGraph() const
 {
-    clearGraphItems();
-    agclose(_graph->graph());
-    _graph->setGraph(agopen(name.toLocal8Bit().data(), Agdirected, NULL));
+    return agnnodes(_graph->graph()) + agnedges(_graph->graph()) > _autoLayoutThreshold;
 }
 
-void QGVScene::loadLayout(const QString &text)
+QGVLayoutRequest QGVScene::layoutRequest()
 {
-    clearGraphItems();
-    agclose(_graph->graph());
+    const bool autoLarge = _layoutEngine == AutoEngine && isLargeGraph();
+    LayoutEngine engine = _layoutEngine != AutoEngine ? _layoutEngine
+                                                      : autoLarge ? _largeGraphEngine : DotEngine;
+    const int step = _layoutPreset + _fallbackLevel;
+    LayoutPreset preset = LayoutPreset(qMin<int>(step, FastPreset));
 
-    _graph->setGraph(QGVCore::agmemread2(text.toLocal8Bit().constData()));
+    if (autoLarge && engine == DotEngine)
+        preset = qMax(preset, BalancedPreset);
 
-    if (!_graph->graph())
-        return;
+    if (step > FastPreset && engine == DotEngine)
+        engine = _largeGraphEngine == DotEngine ? SfdpEngine : _largeGraphEngine;
 
-    //Debug output
-		//gvRenderFilename(_context->context(), _graph->graph(), "png", "debug.png");
+    QMap<QString, QString> options;
+    insert_preset_options(options, engine, preset);
 
-    // Add subgraphs first to layer them below other items.
-    // Note: The loop only picks up the immediate subgraphs of the given graph.
-    // Recursion would be needed to find all subgraphs.
-    for (auto sg = agfstsubg(_graph->graph()); sg; sg = agnxtsubg(sg))
+    // The seeded positions are in points
+    if (_stableLayout && (engine == NeatoEngine || engine == FdpEngine))
+        options.insert("inputscale", "72");
+
+    const auto userOptions = _layoutEngineOptions.value(engine);
+
+    for (auto it = userOptions.begin(); it != userOptions.end(); ++it)
+        options.insert(it.key(), it.value());
+
+    QGVLayoutRequest request;
+    request.engine = layoutEngineName(engine);
+
+    for (auto it = options.begin(); it != options.end(); ++it)
+        request.options.append(qMakePair(it.key().toLocal8Bit(), it.value().toLocal8Bit()));
+
+    _effectiveLayoutEngine = engine;
+    _effectiveLayoutPreset = preset;
+    _cheaperLayoutAvailable = preset != FastPreset || engine == DotEngine;
+    return request;
+}
+
+QVector<QPair<Agnode_t *, QByteArray>> QGVScene::seedStablePositions()
+{
+    QVector<QPair<Agnode_t *, QByteArray>> previous;
+
+    if (!_stableLayout || _bulkRendering || !_hasLayout
+        || (_effectiveLayoutEngine != NeatoEngine && _effectiveLayoutEngine != FdpEngine))
+        return previous;
+
+    Agraph_t *graph = _graph->graph();
+
+    // Nodes free to move: the ones changed since the last layout, the ends
+    // of changed edges and their neighbors
+    QSet<Agnode_t *> changed;
+
+    for (auto it = _dirtyItems.begin(); it != _dirtyItems.end(); ++it)
+    {
+        if (!(it.value() & QGVCore::LayoutEffect))
+            continue;
+
+        if (auto node = qgraphicsitem_cast<QGVNode *>(it.key()))
+        {
+            changed.insert(node->_node->node());
+        }
+        else if (auto edge = qgraphicsitem_cast<QGVEdge *>(it.key()))
+        {
+            changed.insert(agtail(edge->_edge->edge()));
+            changed.insert(aghead(edge->_edge->edge()));
+        }
+    }
+
+    QSet<Agnode_t *> moving = changed;
+
+    for (auto node: changed)
     {
-        auto sgItem = new QGVSubGraph(new QGVGraphPrivate(sg), this);
-        addItem(sgItem);
-        _subGraphs.append(sgItem);
+        for (Agedge_t *edge = agfstedge(graph, node); edge; edge = agnxtedge(graph, edge, node))
+        {
+            moving.insert(agtail(edge));
+            moving.insert(aghead(edge));
+        }
     }
 
-    //Read nodes and edges
-    for (Agnode_t* node = agfstnode(_graph->graph()); node != NULL; node = agnxtnode(_graph->graph(), node))
+    // Laid out nodes have a shape, the center is their position
+    auto position = [this] (Agnode_t *node, QPointF *center)
+    {
+        QGVNode *item = _nodes.value(node);
+
+        if (!item || item->boundingRect().isEmpty())
+            return false;
+
+        *center = item->mapToScene(item->boundingRect().center());
+        return true;
+    };
+
+    Agsym_t *pos = attributeSymbol(AGNODE, PosKey, true);
+    previous.reserve(_nodes.size());
+
+    for (Agnode_t *node = agfstnode(graph); node; node = agnxtnode(graph, node))
     {
-        QGVNode *inode = new QGVNode(new QGVNodePrivate(node, _graph->graph()), this);
-        //inode->updateLayout();
-        addItem(inode);
-        _nodes.append(inode);
-        for (Agedge_t* edge = agfstout(_graph->graph(), node); edge != NULL; edge = agnxtout(_graph->graph(), edge))
+        const QByteArray value = agxget(node, pos);
+
+        if (!value.isEmpty())
+            continue;
+
+        QPointF center;
+        const bool laidOut = position(node, &center);
+
+        if (!laidOut)
         {
-            QGVEdge *iedge = new QGVEdge(new QGVEdgePrivate(edge), this);
-            iedge->setFlag(QGraphicsItem::ItemIsSelectable, false);
-            //iedge->updateLayout();
-            addItem(iedge);
-            _edges.append(iedge);
+            // Start next to the laid out neighbors, if there are any
+            QPointF sum;
+            int count = 0;
+
+            for (Agedge_t *edge = agfstedge(graph, node); edge; edge = agnxtedge(graph, edge, node))
+            {
+                QPointF neighbor;
+
+                if (position(agtail(edge) == node ? aghead(edge) : agtail(edge), &neighbor))
+                {
+                    sum += neighbor;
+                    ++count;
+                }
+            }
+
+            if (!count)
+                continue;
+
+            center = sum / count;
         }
 
+        // Graphviz coordinates grow upwards, "!" pins the node
+        QByteArray seed = QByteArray::number(center.x(), 'f', 2) + ',' + QByteArray::number(-center.y(), 'f', 2);
+        if (laidOut && !moving.contains(node))
+            seed += '!';
+
+        previous.append(qMakePair(node, value));
+        agxset(node, pos, seed.data());
     }
 
-    applyLayout();
+    return previous;
 }
 
-void QGVScene::applyLayout()
+void QGVScene::restoreStablePositions(const QVector<QPair<Agnode_t *, QByteArray>> &previous)
+{
+    if (previous.isEmpty())
+        return;
+
+    Agsym_t *pos = attributeSymbol(AGNODE, PosKey, false);
+
+    for (auto node: previous)
+        agxset(node.first, pos, node.second.data());
+}
+
+void QGVScene::finishLayout(const QGVLayoutData &layout)
 {
-    if(gvLayout(_context->context(), _graph->graph(), "dot") != 0)
+    _budgetTimer->stop();
+    _asyncLayoutPending = false;
+
+    if (!layout.valid)
     {
-        /*
-         * Si plantage ici :
-         *  - Verifier que les dll sont dans le repertoire d'execution
-         *  - Verifie que le fichier "configN" est dans le repertoire d'execution !
-         */
-        qCritical()<<"Layout render error"<<agerrors()<<QString::fromLocal8Bit(aglasterr());
+        emit layoutFinished(false);
+        finishStats();
         return;
     }
 
-    //Debug output
-		//gvRenderFilename(_context->context(), _graph->graph(), "canon", "debug.dot");
-		//gvRenderFilename(_context->context(), _graph->graph(), "png", "debug.png");
+    if (_statsRunning)
+    {
+        // Measured on the worker thread
+        _stats.layoutTime += layout.layoutTime;
+        _stats.conversionTime += layout.conversionTime;
+    }
 
-    updateLayout();
+    updateLayout(layout);
+    {
+        PhaseTimer timer(_statsRunning, _stats.sceneRectTime);
+        setSceneRect(itemsBoundingRect());
+    }
+    update();
+    emit layoutFinished(true);
+    finishStats();
+}
 
-    gvFreeLayout(_context->context(), _graph->graph());
+bool QGVScene::isStatsEnabled() const
+{
+    return _statsEnabled || qgvStats().isDebugEnabled();
+}
 
-    setSceneRect(itemsBoundingRect());
-    update();
+void QGVScene::beginStats()
+{
+    if (_statsRunning || !isStatsEnabled())
+        return;
+
+    _statsRunning = true;
+    _stats = LayoutStats();
+    _statsLabelBase = _labelCache->parsed();
+    _statsAllocationBase = allocatorStats().allocations;
+    _statsTimer.start();
+}
+
+void QGVScene::finishStats()
+{
+    if (!_statsRunning)
+        return;
+
+    _statsRunning = false;
+    _stats.totalTime = _statsTimer.nsecsElapsed();
+    _stats.labelsParsed = _labelCache->parsed() - _statsLabelBase;
+    _stats.itemsCreated = allocatorStats().allocations - _statsAllocationBase;
+    _stats.engine = _effectiveLayoutEngine;
+    _stats.preset = _effectiveLayoutPreset;
+
+    qCDebug(qgvStats).nospace()
+        << layoutEngineName(_stats.engine).constData() << " " << _stats.preset
+        << (_stats.cacheHit ? " (cached)" : "")
+        << ": total " << to_ms(_stats.totalTime) << " ms, parse " << to_ms(_stats.parseTime)
+        << " ms, items " << to_ms(_stats.itemCreationTime) << " ms, layout " << to_ms(_stats.layoutTime)
+        << " ms, conversion " << to_ms(_stats.conversionTime) << " ms, item update " << to_ms(_stats.itemUpdateTime)
+        << " ms, scene rect " << to_ms(_stats.sceneRectTime) << " ms; " << _stats.bytesParsed << " bytes, "
+        << _stats.itemsCreated << " items, " << _stats.itemsReused << " reused, " << _stats.labelsParsed << " labels";
+
+    emit layoutStats(_stats);
 }
 
 void QGVScene::clearGraphItems()
 {
-    gvFreeLayout(_context->context(), _graph->graph());
+    supersedeLayouts();
+    _pendingItems.clear();
+    _pendingItemIndex.clear();
+    for (auto &symbols: _attributeSymbols)
+        symbols.clear();
+    // No layout to free, applyLayout() does not leave one attached to the
+    // scene graph.
     for (auto node: _nodes)
         delete node;
     _nodes.clear();
+    _nodesByName.clear();
 
     for (auto edge: _edges)
         delete edge;
@@ -283,6 +1832,7 @@ void QGVScene::clearGraphItems()
     for (auto sg: _subGraphs)
         delete sg;
     _subGraphs.clear();
+    _subGraphsByName.clear();
 
     if (_graphLabelItem)
     {
@@ -290,12 +1840,28 @@ void QGVScene::clearGraphItems()
         delete _graphLabelItem;
         _graphLabelItem = nullptr;
     }
+
+    if (_bulkItem)
+        _bulkItem->clear();
+
+    _labelCache->clear();
+    _itemIndex->clear();
+    _itemIndexDirty = true;
+    _dirtyItems.clear();
+
+    // The items are gone, release the slabs of their private objects.
+    _pools->clear();
+    _layoutDirty = false;
+    _hasLayout = false;
 }
 
 void QGVScene::contextMenuEvent(QGraphicsSceneContextMenuEvent *contextMenuEvent)
 {
-    QGraphicsItem *item = itemAt(contextMenuEvent->scenePos(), QTransform());
-    if(item)
+    QGraphicsItem *item = graphItemsAt(contextMenuEvent->scenePos()).value(0);
+    // Other items, e.g. labels, fall through to graphContextMenuEvent()
+    if(!item)
+        item = itemAt(contextMenuEvent->scenePos(), QTransform());
+    if(item && item != _bulkItem)
     {
         item->setSelected(true);
         if(item->type() == QGVNode::Type)
@@ -312,9 +1878,7 @@ void QGVScene::contextMenuEvent(QGraphicsSceneContextMenuEvent *contextMenuEvent
 
 void QGVScene::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *mouseEvent)
 {
-    auto items = this->items(mouseEvent->scenePos());
-
-    for (auto item: items)
+    for (auto item: graphItemsAt(mouseEvent->scenePos()))
     {
         if(item->type() == QGVNode::Type)
         {
@@ -338,6 +1902,10 @@ void QGVScene::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *mouseEvent)
 
 void QGVScene::drawBackground(QPainter * painter, const QRectF & rect)
 {
+    // A frame is background, items and foreground
+    if (isStatsEnabled())
+        _paintTimer.start();
+
     if (!shouldDrawBackgroundGrid())
         return;
 
@@ -361,30 +1929,161 @@ void QGVScene::drawBackground(QPainter * painter, const QRectF & rect)
     //painter->drawRect(sceneRect());
 }
 
+void QGVScene::drawForeground(QPainter *, const QRectF &)
+{
+    if (_paintTimer.isValid())
+    {
+        _stats.paintTime = _paintTimer.nsecsElapsed();
+        _paintTimer.invalidate();
+    }
+}
+
 void QGVScene::updateLayout()
 {
-    for (auto n: _nodes)
-        n->updateLayout();
+    const boxf bb = GD_bb(_graph->graph());
+    const QVector<QGVNode *> nodes = _nodes.values().toVector();
+    const QVector<QGVEdge *> edges = _edges.values().toVector();
+    QVector<QGVNodeLayout> nodeLayouts(nodes.size());
+    QVector<QGVEdgeLayout> edgeLayouts(edges.size());
+    QGVNodeLayout *nodeData = nodeLayouts.data();
+    QGVEdgeLayout *edgeData = edgeLayouts.data();
 
-    for (auto e: _edges)
-        e->updateLayout();
+    // Convert the geometry on the thread pool, then apply it to the items
+    // here.
+    PhaseTimer conversionTimer(_statsRunning, _stats.conversionTime);
+    QGVLayoutData::parallelFor(nodes.size() + edges.size(), [&] (int i)
+    {
+        if (i < nodes.size())
+            nodeData[i] = QGVLayoutData::nodeLayout(nodes.at(i)->_node->node(), bb);
+        else
+            edgeData[i - nodes.size()] = QGVLayoutData::edgeLayout(edges.at(i - nodes.size())->_edge->edge(), bb);
+    });
+    conversionTimer.stop();
+
+    PhaseTimer updateTimer(_statsRunning, _stats.itemUpdateTime);
+
+    for (int i = 0; i < nodes.size(); i++)
+        nodes[i]->updateLayout(nodeLayouts.at(i));
+
+    for (int i = 0; i < edges.size(); i++)
+        edges[i]->updateLayout(edgeLayouts.at(i));
 
     for (auto s: _subGraphs)
         s->updateLayout();
 
     //Graph label
-    if (textlabel_t *xlabel = GD_label(_graph->graph()))
+    updateGraphLabel(QGVLayoutData::labelLayout(GD_label(_graph->graph()), GD_bb(_graph->graph())));
+
+    // Bulk load the index while the geometry is fresh
+    if (_itemIndexType == RTreeItemIndex)
+        rebuildItemIndex();
+    _hasLayout = true;
+}
+
+void QGVScene::updateLayout(const QGVLayoutData &layout)
+{
+    PhaseTimer updateTimer(_statsRunning, _stats.itemUpdateTime);
+
+    if (_bulkRendering)
+    {
+        if (!_bulkItem)
+        {
+            _bulkItem = new QGVBulkItem(this);
+            addItem(_bulkItem);
+        }
+
+        _bulkItem->setLayout(layout);
+        updateGraphLabel(layout.graphLabel);
+        _hasLayout = true;
+        return;
+    }
+
+    QHash<QByteArray, const QGVNodeLayout *> nodeLayouts;
+    QHash<QByteArray, const QGVEdgeLayout *> edgeLayouts;
+    QHash<QByteArray, const QGVSubGraphLayout *> subGraphLayouts;
+
+    for (const auto &l: layout.nodes)
+        nodeLayouts.insert(l.name, &l);
+
+    for (const auto &l: layout.edges)
+        edgeLayouts.insert(l.key, &l);
+
+    for (const auto &l: layout.subGraphs)
+        subGraphLayouts.insert(l.name, &l);
+
+    QVector<QPair<QGVNode *, const QGVNodeLayout *>> nodes;
+    QVector<QPair<QGVEdge *, const QGVEdgeLayout *>> edges;
+    QVector<QPair<QGVSubGraph *, const QGVSubGraphLayout *>> subGraphs;
+
+    // Items created after the layout request was made keep their geometry
+    // until the next layout.
+    for (auto n: _nodes)
+    {
+        if (auto l = nodeLayouts.value(QGVCore::nameOf(n->_node->node())))
+            nodes.append(qMakePair(n, l));
+    }
+
+    QHash<Agedge_t *, QByteArray> edgeKeys;
+
+    for (const auto &keyed: QGVLayoutData::keyedEdges(_graph->graph(), false))
+        edgeKeys.insert(keyed.first, keyed.second);
+
+    for (auto e: _edges)
+    {
+        if (auto l = edgeLayouts.value(edgeKeys.value(e->_edge->edge())))
+            edges.append(qMakePair(e, l));
+    }
+
+    for (auto s: _subGraphs)
+    {
+        if (auto l = subGraphLayouts.value(QGVCore::nameOf(s->_sgraph->graph())))
+            subGraphs.append(qMakePair(s, l));
+    }
+
+    for (const auto &match: nodes)
+        match.first->updateLayout(*match.second);
+
+    for (const auto &match: edges)
+        match.first->updateLayout(*match.second);
+
+    for (const auto &match: subGraphs)
+        match.first->updateLayout(*match.second);
+
+    updateGraphLabel(layout.graphLabel);
+
+    // Bulk load the index while the geometry is fresh
+    if (_itemIndexType == RTreeItemIndex)
+        rebuildItemIndex();
+    _hasLayout = true;
+}
+
+void QGVScene::updateGraphLabel(const QGVLabelLayout &label)
+{
+    if (label.valid)
     {
         if (!_graphLabelItem)
         {
-            _graphLabelItem = new QGraphicsTextItem;
+            _graphLabelItem = new QGVLabelItem(this);
             addItem(_graphLabelItem);
         }
 
-        _graphLabelItem->setPos(QGVCore::centerToOrigin(QGVCore::toPoint(xlabel->pos, QGVCore::graphHeight(_graph->graph())), xlabel->dimen.x, -4));
-        _graphLabelItem->setPlainText(xlabel->text);
+        Agsym_t *fontColor = attributeSymbol(AGRAPH, QGVAttributeKey::FontColor, false);
+        _graphLabelItem->setColor(QGVCore::toColor(fontColor ? agxget(_graph->graph(), fontColor) : QString()));
+        _graphLabelItem->setPos(QGVCore::centerToOrigin(label.center, label.width, -4));
+        _graphLabelItem->setText(label.text, Qt::PlainText);
         _graphLabelItem->show();
     }
     else if (_graphLabelItem)
         _graphLabelItem->hide();
 }
+
+int QGVScene::supersedeLayouts()
+{
+    _budgetTimer->stop();
+
+    if (_layoutServiceJob && _layoutService)
+        _layoutService->cancel(_layoutServiceJob);
+    _layoutServiceJob = 0;
+
+    return _layoutGeneration->fetchAndAddOrdered(1) + 1;
+}
@@ -19,15 +19,35 @@ License along with this library.
 #define QGVSCENE_H
 
 #include "qgv_export.h"
+#include <QAtomicInt>
+#include <QElapsedTimer>
 #include <QGraphicsScene>
+#include <QHash>
+#include <QMap>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QVector>
 #include <cgraph.h> // for Agraph_t*, was not able to forward declare it (FIXME)
 
 class QGVNode;
 class QGVEdge;
 class QGVSubGraph;
 
+class QGVAttributeKey;
+class QGVBulkItem;
 class QGVGraphPrivate;
 class QGVGvcPrivate;
+class QGVItemIndex;
+class QGVLabelCache;
+class QGVLabelItem;
+class QGVLayoutCache;
+class QGVLayoutService;
+class QIODevice;
+class QTimer;
+struct QGVLabelLayout;
+struct QGVLayoutData;
+struct QGVLayoutRequest;
+struct QGVPrivatePools;
 
 /**
  * @brief GraphViz interactive scene
@@ -37,6 +57,83 @@ class QGVCORE_EXPORT QGVScene : public QGraphicsScene
 {
     Q_OBJECT
 public:
+    enum LayoutEngine
+    {
+        DotEngine,
+        NeatoEngine,
+        FdpEngine,
+        SfdpEngine,
+        TwopiEngine,
+        CircoEngine,
+        // dot for small graphs, see setAutoLayoutPolicy()
+        AutoEngine
+    };
+    Q_ENUM(LayoutEngine)
+
+    // Trade off between layout quality and time. BalancedPreset and
+    // FastPreset bound the passes of dot (nslimit, nslimit1, mclimit,
+    // searchsize) and the iterations of the force directed engines
+    // (maxiter), FastPreset also routes edges as straight lines.
+    enum LayoutPreset
+    {
+        QualityPreset,
+        BalancedPreset,
+        FastPreset
+    };
+    Q_ENUM(LayoutPreset)
+
+    enum LoadMode
+    {
+        // Delete the items of the previous graph and create new ones
+        ReplaceItems,
+        // Keep the items of nodes and subgraphs with the same name and edges
+        // with the same tail, head and key, only create and delete the
+        // difference. Item state like the selection survives the load.
+        ReuseItems
+    };
+    Q_ENUM(LoadMode)
+
+    enum ItemIndex
+    {
+        // QGraphicsScene's own index
+        QtItemIndex,
+        // R-tree with one box per edge segment, rebuilt after each layout
+        RTreeItemIndex
+    };
+    Q_ENUM(ItemIndex)
+
+    // Breakdown of the last load or layout, times in nanoseconds. Only
+    // recorded while stats are enabled, see setStatsEnabled().
+    struct LayoutStats
+    {
+        qint64 parseTime = 0;           // DOT text to cgraph
+        qint64 itemCreationTime = 0;    // items of a loaded graph
+        qint64 layoutTime = 0;          // layout engine
+        qint64 conversionTime = 0;      // layout records to scene geometry
+        qint64 itemUpdateTime = 0;      // geometry, styles and labels to the items
+        qint64 sceneRectTime = 0;       // setSceneRect(itemsBoundingRect())
+        qint64 totalTime = 0;           // including waits for asynchronous layouts
+        qint64 paintTime = 0;           // last frame drawn by a view
+        quint64 bytesParsed = 0;        // 0 for sequential devices
+        quint64 itemsCreated = 0;       // nodes, edges and subgraphs
+        quint64 itemsReused = 0;        // kept from the previous graph, see ReuseItems
+        quint64 labelsParsed = 0;       // texts laid out, not taken from the label cache
+        bool cacheHit = false;
+        LayoutEngine engine = DotEngine;
+        LayoutPreset preset = QualityPreset;
+    };
+
+    // Slab allocator of the private objects of the nodes, edges and
+    // subgraphs, summed over the three object kinds.
+    struct AllocatorStats
+    {
+        quint64 liveObjects = 0;
+        quint64 slabs = 0;
+        quint64 reservedBytes = 0;
+        quint64 allocations = 0;        // since the scene was created
+        quint64 reusedSlots = 0;        // allocations served by freed objects
+        quint64 slabAllocations = 0;    // slabs requested from the heap
+    };
 
     explicit QGVScene(QObject *parent = 0);
     explicit QGVScene(const QString &name, QObject *parent = 0);
@@ -50,25 +147,292 @@ public:
     QGVEdge* addEdge(QGVNode* source, QGVNode* target, const QString& label=QString());
     QGVSubGraph* addSubGraph(const QString& name, bool cluster=true);
 
+    // Deleting a node also deletes its incident edges, deleting a subgraph
+    // also deletes the subgraphs nested in it.
     void deleteNode(QGVNode *node);
     void deleteEdge(QGVEdge *edge);
     void deleteSubGraph(QGVSubGraph *subgraph);
+    // Deletes nodes, edges and subgraphs. Items already deleted as part of
+    // another item in the list are skipped.
+    void deleteItems(const QList<QGraphicsItem *> &items);
 
     void setRootNode(QGVNode *node);
 
+    // Lookups by graphviz name, backed by an index maintained by the add,
+    // load and delete functions. Subgraphs are found by their graph name,
+    // e.g. "cluster_foo" for addSubGraph("foo").
+    QGVNode *findNode(const QString &name) const;
+    QGVEdge *findEdge(const QString &tail, const QString &head, const QString &key = {}) const;
+    QGVSubGraph *findSubGraph(const QString &name) const;
+
+    // Batches graph construction. Until the matching endUpdate() new items
+    // are kept out of the scene and its index, and layout requests are
+    // deferred. Calls may be nested. The counts are reservation hints.
+    void beginUpdate(int expectedNodes = 0, int expectedEdges = 0);
+    void endUpdate();
+
+    bool isUpdating() const
+    {
+        return _updateDepth > 0;
+    }
+
     bool shouldDrawBackgroundGrid() const
     {
         return drawBackgroundGrid_;
     }
 
+    // Attribute changes are applied once control returns to the event loop,
+    // coalescing the changes made until then. Style attributes (color,
+    // fillcolor, penwidth, tooltip, ...) only refresh the changed items.
+    // Layout attributes (label, shape, width, rankdir, ...) and added or
+    // deleted items mark the layout dirty, with autoRelayout() a laid out
+    // graph is then laid out again, once. applyLayout() clears the state.
+    bool isLayoutDirty() const
+    {
+        return _layoutDirty;
+    }
+
+    bool autoRelayout() const
+    {
+        return _autoRelayout;
+    }
+
+    void setAutoRelayout(bool enabled)
+    {
+        _autoRelayout = enabled;
+    }
+
     Agraph_t *graph();
 
     QString toDot() const;
+    // Same as toDot() without the conversion to QString.
+    QByteArray toDotBytes() const;
+    // Streams the DOT text into the device, e.g. for very large graphs.
+    bool toDot(QIODevice *device) const;
+
+    // Stream the DOT text into the parser instead of going through a
+    // QString. Files are memory mapped if possible. Sequential devices are
+    // not streamed but buffered up to their end first, giving up if no data
+    // arrives for 30 s. Return false and leave the scene untouched if the
+    // input could not be read or parsed.
+    bool loadLayoutFromFile(const QString &path);
+    bool loadLayout(QIODevice *device);
+
+    // How the loadLayout functions treat the items of the current graph.
+    // Bulk rendering always replaces them.
+    LoadMode loadMode() const
+    {
+        return _loadMode;
+    }
+
+    void setLoadMode(LoadMode mode)
+    {
+        _loadMode = mode;
+    }
+
+    // If enabled applyLayout() computes the layout on a worker thread. The
+    // current items stay interactive until the result has been applied.
+    // Graphviz is not reentrant, a layout on a worker thread holds the
+    // global Graphviz lock until it is done. Calls that parse or write DOT
+    // text wait for it: the loadLayout() functions, toDot() and
+    // toDotBytes(), a synchronous applyLayout() and the QGVScene constructor
+    // and destructor. So do adding and removing anonymous nodes and
+    // subgraphs. A layoutService() runs the layouts in other processes and
+    // avoids the wait.
+    bool isAsyncLayout() const
+    {
+        return _asyncLayout;
+    }
+
+    // Optional cache of computed layouts. Not owned by the scene.
+    QGVLayoutCache *layoutCache() const
+    {
+        return _layoutCache;
+    }
+
+    void setLayoutCache(QGVLayoutCache *cache)
+    {
+        _layoutCache = cache;
+    }
+
+    // Optional pool of worker processes to run layouts in, so layouts of
+    // several scenes run in parallel and a crashing layout does not take
+    // the application down. Layouts are asynchronous while a service is
+    // set, they run on a worker thread instead if the worker program is
+    // not available. Jobs with a higher priority are started first. Not
+    // owned by the scene.
+    QGVLayoutService *layoutService() const;
+    void setLayoutService(QGVLayoutService *service, int priority = 0);
+
+    LayoutEngine layoutEngine() const
+    {
+        return _layoutEngine;
+    }
+
+    void setLayoutEngine(LayoutEngine engine)
+    {
+        _layoutEngine = engine;
+    }
+
+    // Graph attributes set for the duration of layouts run with the engine,
+    // e.g. setLayoutEngineOption(SfdpEngine, "overlap", "prism"). An empty
+    // value removes the option.
+    void setLayoutEngineOption(LayoutEngine engine, const QString &name, const QString &value);
+    QMap<QString, QString> layoutEngineOptions(LayoutEngine engine) const
+    {
+        return _layoutEngineOptions.value(engine);
+    }
+
+    // With AutoEngine graphs with more than elementThreshold nodes plus edges
+    // are laid out with largeGraphEngine. If that is dot, it is run with
+    // reduced iteration limits.
+    void setAutoLayoutPolicy(int elementThreshold, LayoutEngine largeGraphEngine = SfdpEngine);
+
+    // The engine the last layout was requested with, AutoEngine resolved.
+    LayoutEngine effectiveLayoutEngine() const
+    {
+        return _effectiveLayoutEngine;
+    }
+
+    LayoutPreset layoutPreset() const
+    {
+        return _layoutPreset;
+    }
+
+    void setLayoutPreset(LayoutPreset preset);
+
+    // Milliseconds a layout may take, 0 for no limit. A layout running in a
+    // layoutService() past it is cancelled and restarted with the next
+    // cheaper preset, past FastPreset dot falls back to the large graph
+    // engine of setAutoLayoutPolicy(). Graphviz cannot be interrupted in
+    // process, a restart would wait for the running layout. Synchronous
+    // layouts and those on a worker thread run to completion, running past
+    // the budget makes the following layouts cheaper instead.
+    // The fallback is reset when a graph is loaded or the preset or budget
+    // changes.
+    int layoutTimeBudget() const
+    {
+        return _layoutTimeBudget;
+    }
+
+    void setLayoutTimeBudget(int msecs);
+
+    // The preset the last layout was requested with, including fallbacks
+    // and the reduced limits of AutoEngine for large graphs.
+    LayoutPreset effectiveLayoutPreset() const
+    {
+        return _effectiveLayoutPreset;
+    }
+
+    // With NeatoEngine and FdpEngine a relayout starts from the current
+    // node positions. Nodes are pinned in place except the ones added or
+    // changed since the last layout, the ends of added edges and their
+    // neighbors, so the rest of the graph keeps its shape and the engine
+    // converges faster. New nodes start next to their neighbors. Nodes with
+    // a pos attribute of their own are left alone. Not used by the other
+    // engines and in bulk rendering mode.
+    bool isStableLayout() const
+    {
+        return _stableLayout;
+    }
+
+    void setStableLayout(bool stable)
+    {
+        _stableLayout = stable;
+    }
+
+    static QByteArray layoutEngineName(LayoutEngine engine);
+
+    // All scenes share one Graphviz context, created with the first scene.
+    // Returns the time its creation took in nanoseconds.
+    static qint64 contextCreationTime();
+
+    // Level of detail thresholds, compared against the scale the items are
+    // painted at. Below labelDetailThreshold() labels are skipped and nodes
+    // are drawn as plain rectangles. Below edgeDetailThreshold() edges are
+    // drawn as straight lines without arrows, or not at all if
+    // hideLowDetailEdges() is set.
+    qreal labelDetailThreshold() const
+    {
+        return _labelDetailThreshold;
+    }
+
+    qreal edgeDetailThreshold() const
+    {
+        return _edgeDetailThreshold;
+    }
+
+    bool hideLowDetailEdges() const
+    {
+        return _hideLowDetailEdges;
+    }
+
+    void setDetailThresholds(qreal labelThreshold, qreal edgeThreshold);
+    void setHideLowDetailEdges(bool hide);
+
+    // Draws the whole graph through a single item instead of one item per
+    // node, edge and label, for graphs with 100k+ elements. Node, edge and
+    // subgraph objects are then only created on demand, e.g. by findNode()
+    // or for the context menu and double click signals, and are not part of
+    // the QGraphicsScene. Changing the mode recreates the items of the
+    // current graph.
+    bool isBulkRendering() const
+    {
+        return _bulkRendering;
+    }
+
+    void setBulkRendering(bool bulk);
+
+    AllocatorStats allocatorStats() const;
+
+    // Records LayoutStats and emits layoutStats(). Stats are also recorded
+    // while debug output of the "qgv.stats" logging category is enabled,
+    // which then logs them after each load and layout.
+    bool isStatsEnabled() const;
+    void setStatsEnabled(bool enabled)
+    {
+        _statsEnabled = enabled;
+    }
+
+    // Stats of the last finished load or layout, paintTime is updated with
+    // each frame.
+    LayoutStats lastLayoutStats() const
+    {
+        return _stats;
+    }
+
+    // Index used by graphItemsAt() and graphItemsIn() and the context menu
+    // and double click handling. The QGraphicsScene index is kept for
+    // painting either way.
+    ItemIndex itemIndex() const
+    {
+        return _itemIndexType;
+    }
+
+    void setItemIndex(ItemIndex index);
+
+    // Visible nodes, edges and subgraphs whose shape contains pos or
+    // intersects rect, topmost first. In bulk rendering mode graphItemsAt()
+    // returns the handle of the topmost object and graphItemsIn() nothing.
+    QList<QGraphicsItem *> graphItemsAt(const QPointF &pos);
+    QList<QGraphicsItem *> graphItemsIn(const QRectF &rect, Qt::ItemSelectionMode mode = Qt::IntersectsItemShape);
 
 public slots:
     void newGraph(const QString &name = "qgv");
     void loadLayout(const QString &text); // Load from DOT text
     void applyLayout();
+    // Snapshots the graph and lays it out on a worker thread. Results of a
+    // request superseded by a newer layout or a graph change are dropped.
+    void applyLayoutAsync();
+    // Drops the running layout and emits layoutFinished(false) if one was
+    // started asynchronously. The worker process of a layout service is
+    // killed. Graphviz cannot be interrupted in process, a worker thread
+    // skips its remaining phases and the result is discarded.
+    void cancelLayout();
+    void setAsyncLayout(bool async)
+    {
+        _asyncLayout = async;
+    }
     void clearGraphItems();
     void setDrawBackgroundGrid(bool drawGrid)
     {
@@ -88,25 +452,151 @@ signals:
 
     void graphContextMenuEvent();
 
+    void layoutStarted();
+    // Not emitted for superseded asynchronous requests.
+    void layoutFinished(bool success);
+    // Emitted after layoutFinished() while stats are enabled
+    void layoutStats(const QGVScene::LayoutStats &stats);
+    // A layout ran past layoutTimeBudget() with the given settings
+    void layoutBudgetExceeded(QGVScene::LayoutPreset preset, QGVScene::LayoutEngine engine);
+
 protected:
     virtual void contextMenuEvent(QGraphicsSceneContextMenuEvent * contextMenuEvent);
     virtual void mouseDoubleClickEvent(QGraphicsSceneMouseEvent * mouseEvent);
     virtual void drawBackground(QPainter * painter, const QRectF & rect);
+    virtual void drawForeground(QPainter * painter, const QRectF & rect);
 private:
-    void updateLayout(); // calls updateLayout() on all child elements
+    void updateLayout(); // converts the layout of all child elements in parallel and applies it
+    void updateLayout(const QGVLayoutData &layout); // matches the layout to the items by name
+    void updateGraphLabel(const QGVLabelLayout &label);
+    void finishLayout(const QGVLayoutData &layout);
+    int supersedeLayouts();
+    void layoutBudgetExpired();
+    // Checks the time of a synchronous layout against the budget
+    void checkLayoutBudget(qint64 layoutTime);
+    // Start a stats record unless one is running, finish and report it
+    void beginStats();
+    void finishStats();
+    bool isLargeGraph() const;
+    QGVLayoutRequest layoutRequest();
+    // Sets the pos attributes of a stable layout, returns the previous
+    // values to restore once the layout or the DOT snapshot is taken.
+    QVector<QPair<Agnode_t *, QByteArray>> seedStablePositions();
+    void restoreStablePositions(const QVector<QPair<Agnode_t *, QByteArray>> &previous);
+    bool loadGraph(Agraph_t *graph);
+    void createGraphItems();
+    // Replaces the scene graph, matching the items to the new objects
+    void reuseGraphItems(Agraph_t *graph);
+    // Detached items standing in for objects drawn by the bulk item
+    QGVNode *nodeHandle(Agnode_t *node);
+    QGVEdge *edgeHandle(Agedge_t *edge);
+    QGVSubGraph *subGraphHandle(Agraph_t *subgraph);
+    QGraphicsItem *bulkItemAt(const QPointF &pos);
+    void addGraphItem(QGraphicsItem *item);
+    void invalidateItemIndex()
+    {
+        _itemIndexDirty = true;
+    }
+    void rebuildItemIndex();
+    // Dirty state tracking, flags are QGVCore::AttributeEffect values
+    void attributeChanged(QGraphicsItem *item, const QGVAttributeKey &key);
+    void defaultAttributeChanged(int kind, const QString &name);
+    void markDirty(QGraphicsItem *item, int flags);
+    void markLayoutDirty();
+    // Called when a layout is requested, keeps the style flags
+    void clearLayoutDirty();
+    void scheduleDirtyItems();
+    void processDirtyItems();
+    void setItemLabel(QGVNode *node, const QString &label);
+    void setItemLabel(QGVEdge *edge, const QString &label);
+    // Cached cgraph symbol of the key for AGRAPH, AGNODE or AGEDGE objects.
+    // Returns null if the attribute is not declared and declare is false.
+    Agsym_t *attributeSymbol(int kind, const QGVAttributeKey &key, bool declare);
+    void destroyItem(QGraphicsItem *item);
+    void registerNode(Agnode_t *node, QGVNode *item);
+    void registerSubGraph(Agraph_t *subgraph, QGVSubGraph *item);
+    QGVNode *unregisterNode(Agnode_t *node);
+    QGVSubGraph *unregisterSubGraph(Agraph_t *subgraph);
+    void deleteNode(Agnode_t *node);
+    void deleteEdge(Agedge_t *edge);
+    void deleteSubGraph(Agraph_t *subgraph);
+    void forgetSubGraphs(Agraph_t *parent);
     friend class QGVNode;
     friend class QGVEdge;
     friend class QGVSubGraph;
+    friend class QGVLabelItem;
+    friend class QGVBulkItem;
+    QGVLabelCache *labelCache() const
+    {
+        return _labelCache;
+    }
 
     QGVGvcPrivate *_context;
     QGVGraphPrivate *_graph;
     //QFont _font;
 
-    QList<QGVNode*> _nodes;
-    QList<QGVEdge*> _edges;
-    QList<QGVSubGraph*> _subGraphs;
-    QGraphicsTextItem *_graphLabelItem = nullptr;
+    QHash<Agnode_t*, QGVNode*> _nodes;
+    QHash<Agedge_t*, QGVEdge*> _edges;
+    QHash<Agraph_t*, QGVSubGraph*> _subGraphs;
+    QHash<QByteArray, QGVNode*> _nodesByName;
+    QHash<QByteArray, QGVSubGraph*> _subGraphsByName;
+    QGVLabelItem *_graphLabelItem = nullptr;
+    QGVLabelCache *_labelCache;
+    QGVItemIndex *_itemIndex;
+    QGVPrivatePools *_pools;
+    ItemIndex _itemIndexType = RTreeItemIndex;
+    bool _itemIndexDirty = true;
     bool drawBackgroundGrid_ = false;
+    bool _asyncLayout = false;
+    bool _bulkRendering = false;
+    LoadMode _loadMode = ReplaceItems;
+    QGVBulkItem *_bulkItem = nullptr;
+    qreal _labelDetailThreshold = 0.4;
+    qreal _edgeDetailThreshold = 0.15;
+    bool _hideLowDetailEdges = false;
+    QGVLayoutCache *_layoutCache = nullptr;
+    QPointer<QGVLayoutService> _layoutService;
+    int _layoutServicePriority = 0;
+    quint64 _layoutServiceJob = 0;
+    LayoutEngine _layoutEngine = DotEngine;
+    LayoutEngine _effectiveLayoutEngine = DotEngine;
+    LayoutEngine _largeGraphEngine = SfdpEngine;
+    bool _stableLayout = false;
+    int _autoLayoutThreshold = 5000;
+    QMap<int, QMap<QString, QString>> _layoutEngineOptions;
+    LayoutPreset _layoutPreset = QualityPreset;
+    LayoutPreset _effectiveLayoutPreset = QualityPreset;
+    int _layoutTimeBudget = 0;
+    // Steps beyond _layoutPreset taken after running past the budget
+    int _fallbackLevel = 0;
+    bool _cheaperLayoutAvailable = true;
+    bool _asyncLayoutPending = false;
+    QTimer *_budgetTimer;
+
+    bool _statsEnabled = false;
+    bool _statsRunning = false;
+    LayoutStats _stats;
+    quint64 _statsLabelBase = 0;
+    quint64 _statsAllocationBase = 0;
+    QElapsedTimer _statsTimer;
+    QElapsedTimer _paintTimer;
+
+    int _updateDepth = 0;
+    bool _layoutPending = false;
+    // Items of the running batch in insertion order, destroyed ones are
+    // null. The index maps the items to their slot.
+    QVector<QGraphicsItem *> _pendingItems;
+    QHash<QGraphicsItem *, int> _pendingItemIndex;
+    QHash<QGraphicsItem *, int> _dirtyItems;
+    bool _dirtyItemsScheduled = false;
+    bool _layoutDirty = false;
+    bool _autoRelayout = true;
+    // Set once the items have been laid out, changes before are not tracked
+    bool _hasLayout = false;
+    QVector<Agsym_t *> _attributeSymbols[AGEDGE + 1];
+    QSharedPointer<QAtomicInt> _layoutGeneration;
 };
 
+Q_DECLARE_METATYPE(QGVScene::LayoutStats)
+
 #endif // QGVSCENE_H
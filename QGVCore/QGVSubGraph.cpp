@@ -20,16 +20,17 @@ License along with this library.
 #include <QGVScene.h>
 #include <QGVGraphPrivate.h>
 #include <QGVNodePrivate.h>
+#include <QGVPrivatePools.h>
+#include <QGVLayoutData.h>
 #include <QGVNode.h>
 #include <QDebug>
 #include <QPainter>
-#include <QGraphicsTextItem>
-#include <QTextDocument>
+#include <QGVLabelItem.h>
 
 QGVSubGraph::QGVSubGraph(QGVGraphPrivate *subGraph, QGVScene *scene)
     :  _scene(scene)
     , _sgraph(subGraph)
-    , textItem_(new QGraphicsTextItem(this))
+    , textItem_(new QGVLabelItem(scene, this))
 {
     setFlag(QGraphicsItem::ItemIsSelectable, true);
     textItem_->hide();
@@ -37,8 +38,10 @@ QGVSubGraph::QGVSubGraph(QGVGraphPrivate *subGraph, QGVScene *scene)
 
 QGVSubGraph::~QGVSubGraph()
 {
-    _scene->removeItem(this);
-    delete _sgraph;
+    // Items created within a batch update may not be part of the scene yet.
+    if (scene())
+        _scene->removeItem(this);
+    _scene->_pools->graphs.destroy(_sgraph);
 }
 
 QString QGVSubGraph::name() const
@@ -62,11 +65,12 @@ QGVNode *QGVSubGraph::addNode(const QString &label, const QString &id)
     }
     agsubnode(_sgraph->graph(), node, true);
 
-    QGVNode *item = new QGVNode(new QGVNodePrivate(node, _sgraph->graph()), _scene);
-    item->setLabel(label);
-    _scene->addItem(item);
-    _scene->_nodes.append(item);
-    _nodes.append(item);
+    QGVNode *item = new QGVNode(_scene->_pools->nodes.create(node, _sgraph->graph()), _scene);
+    _scene->setItemLabel(item, label);
+    _scene->addGraphItem(item);
+    _scene->registerNode(node, item);
+    _scene->markDirty(item, QGVCore::LayoutEffect);
+    _scene->markLayoutDirty();
     return item;
 }
 
@@ -84,15 +88,19 @@ QGVSubGraph *QGVSubGraph::addSubGraph(const QString &name, bool cluster)
         return 0;
     }
 
-    QGVSubGraph *item = new QGVSubGraph(new QGVGraphPrivate(sgraph), _scene);
-    _scene->_subGraphs.append(item);
-    _scene->addItem(item);
+    QGVSubGraph *item = new QGVSubGraph(_scene->_pools->graphs.create(sgraph), _scene);
+    _scene->registerSubGraph(sgraph, item);
+    _scene->addGraphItem(item);
+    _scene->markDirty(item, QGVCore::LayoutEffect);
+    _scene->markLayoutDirty();
     return item;
 }
 
 QRectF QGVSubGraph::boundingRect() const
 {
-    return QRectF(0,0, _width, _height);
+    // Half of the outline is drawn outside of the box
+    const qreal margin = _pen.widthF()/2;
+    return QRectF(0,0, _width, _height).adjusted(-margin, -margin, margin, margin);
 }
 
 void QGVSubGraph::paint(QPainter * painter, const QStyleOptionGraphicsItem *, QWidget *)
@@ -102,15 +110,14 @@ void QGVSubGraph::paint(QPainter * painter, const QStyleOptionGraphicsItem *, QW
     painter->setPen(_pen);
     painter->setBrush(_brush);
 
-    painter->drawRect(boundingRect());
+    painter->drawRect(QRectF(0,0, _width, _height));
 
     painter->restore();
 }
 
 void QGVSubGraph::setAttribute(const QString &name, const QString &value)
 {
-    char empty[] = "";
-    agsafeset(_sgraph->graph(), name.toLocal8Bit().data(), value.toLocal8Bit().data(), empty);
+    setAttribute(QGVAttributeKey(name.toLocal8Bit()), value);
 }
 
 QString QGVSubGraph::getAttribute(const QString &name) const
@@ -121,51 +128,59 @@ QString QGVSubGraph::getAttribute(const QString &name) const
     return QString();
 }
 
+void QGVSubGraph::setAttribute(const QGVAttributeKey &key, const QString &value)
+{
+    agxset(_sgraph->graph(), _scene->attributeSymbol(AGRAPH, key, true), value.toLocal8Bit().data());
+    _scene->attributeChanged(this, key);
+}
+
+QString QGVSubGraph::getAttribute(const QGVAttributeKey &key) const
+{
+    if (Agsym_t *symbol = _scene->attributeSymbol(AGRAPH, key, false))
+        return agxget(_sgraph->graph(), symbol);
+    return QString();
+}
+
 void QGVSubGraph::updateLayout()
+{
+    updateLayout(QGVLayoutData::subGraphLayout(_sgraph->graph(), GD_bb(_scene->_graph->graph())));
+}
+
+void QGVSubGraph::updateLayout(const QGVSubGraphLayout &layout)
 {
     prepareGeometryChange();
 
     //SubGraph box
-    boxf box = GD_bb(_sgraph->graph());
-    pointf p1 = box.UR;
-    pointf p2 = box.LL;
-    _width = p1.x - p2.x;
-    _height = p1.y - p2.y;
+    _width = layout.width;
+    _height = layout.height;
+    setPos(layout.pos);
 
-    qreal gheight = QGVCore::graphHeight(_scene->_graph->graph());
-    setPos(p2.x, gheight - p1.y);
-
-    _pen.setWidth(1);
-    _brush.setStyle(QGVCore::toBrushStyle(getAttribute("style")));
-    _brush.setColor(QGVCore::toColor(getAttribute("fillcolor")));
-    _pen.setColor(QGVCore::toColor(getAttribute("color")));
+    updateRenderState();
 
     //SubGraph label
-    QString label;
-    if (auto xlabel = GD_label(_sgraph->graph()))
-        label = xlabel->text;
+    const QString &label = layout.label;
 
     if (!label.isEmpty())
     {
-        auto topt = textItem_->document()->defaultTextOption();
-        topt.setAlignment(Qt::AlignCenter);
-        topt.setWrapMode(QTextOption::NoWrap);
-        textItem_->document()->setDefaultTextOption(topt);
-        textItem_->setHtml(label);
-        textItem_->adjustSize();
-
-        textItem_->setPos(0, 0);
-        auto itemRect = textItem_->boundingRect();
-        auto nodeCenter = textItem_->mapFromParent(
-            boundingRect().center().x(),
-            boundingRect().top() + textItem_->boundingRect().height()*0.5);
-
-        itemRect.moveCenter(nodeCenter);
-        //qDebug() << this << "node pos=" << pos() << "textItem pos=" << textItem_->pos();
-        //qDebug() << this << "node rect=" << boundingRect() << ", textItem rect=" << textItem_->boundingRect();
-        textItem_->setPos(itemRect.topLeft());
+        textItem_->setText(label);
+        textItem_->setCenter(QPointF(_width*0.5, textItem_->boundingRect().height()*0.5));
         textItem_->show();
     }
     else
         textItem_->hide();
 }
+
+void QGVSubGraph::updateRenderState()
+{
+    const qreal width = QGVCore::toPenWidth(getAttribute(QGVAttributeKey::PenWidth));
+    if (width != _pen.widthF())
+    {
+        prepareGeometryChange();
+        _pen.setWidthF(width);
+    }
+    _brush.setStyle(QGVCore::toBrushStyle(getAttribute(QGVAttributeKey::Style)));
+    _brush.setColor(QGVCore::toColor(getAttribute(QGVAttributeKey::FillColor)));
+    _pen.setColor(QGVCore::toColor(getAttribute(QGVAttributeKey::Color)));
+    textItem_->setColor(QGVCore::toColor(getAttribute(QGVAttributeKey::FontColor)));
+    update();
+}
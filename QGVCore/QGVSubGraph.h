@@ -19,6 +19,7 @@ License along with this library.
 #define QGVSUBGRAPH_H
 
 #include "qgv_export.h"
+#include "QGVAttribute.h"
 #include <QGraphicsItem>
 #include <QPen>
 
@@ -26,7 +27,8 @@ class QGVNode;
 class QGVEdge;
 class QGVScene;
 class QGVGraphPrivate;
-class QGraphicsTextItem;
+struct QGVSubGraphLayout;
+class QGVLabelItem;
 
 /**
  * @brief SubGraph item
@@ -46,6 +48,9 @@ public:
     void paint(QPainter * painter, const QStyleOptionGraphicsItem * option, QWidget * widget = 0);
     void setAttribute(const QString &name, const QString &value);
     QString getAttribute(const QString &name) const;
+    // Same as above through the scene's cached attribute symbols
+    void setAttribute(const QGVAttributeKey &key, const QString &value);
+    QString getAttribute(const QGVAttributeKey &key) const;
     void updateLayout();
 
     enum { Type = UserType + 4 };
@@ -58,6 +63,9 @@ public:
 private:
     friend class QGVScene;
     QGVSubGraph(QGVGraphPrivate* subGraph, QGVScene *scene);
+    void updateLayout(const QGVSubGraphLayout &layout);
+    // Pen and brush from the cgraph attributes
+    void updateRenderState();
 
     QGVScene *_scene;
     QGVGraphPrivate *_sgraph;
@@ -68,9 +76,7 @@ private:
     QString _label;
     QRectF _label_rect;
 
-    QList<QGVNode*> _nodes;
-
-    QGraphicsTextItem *textItem_ = nullptr;
+    QGVLabelItem *textItem_ = nullptr;
 };
 
 #endif // QGVSUBGRAPH_H
@@ -0,0 +1,479 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#include "QGVBulkItem.h"
+#include <QGVAttribute.h>
+#include <QGVCore.h>
+#include <QGVGraphPrivate.h>
+#include <QGVLabelItem.h>
+#include <QGVLayoutData.h>
+#include <QGVScene.h>
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+
+namespace
+{
+// Distance within which a click picks an edge, in scene coordinates
+const qreal EdgePickDistance = 5.0;
+
+void collect_subgraphs(Agraph_t *graph, QHash<QByteArray, Agraph_t *> &dest)
+{
+    for (auto sg = agfstsubg(graph); sg; sg = agnxtsubg(sg))
+    {
+        dest.insert(QGVCore::nameOf(sg), sg);
+        collect_subgraphs(sg, dest);
+    }
+}
+
+QString attribute(void *object, Agsym_t *symbol)
+{
+    return symbol ? QString(agxget(object, symbol)) : QString();
+}
+
+void draw_label(QPainter *painter, const QPointF &center, const QGVLabelText &text, const QColor &color)
+{
+    if (text.isEmpty())
+        return;
+
+    const QSizeF size = text.size();
+    text.draw(painter, center - QPointF(size.width()/2, size.height()/2), color);
+}
+}
+
+quint8 QGVBulkItem::styleFlags(const QString &style)
+{
+    quint8 flags = 0;
+    if (QGVCore::toBrushStyle(style) != Qt::NoBrush)
+        flags |= Filled;
+    if (QGVCore::isInvisible(style))
+        flags |= Invisible;
+    return flags;
+}
+
+QGVBulkItem::QGVBulkItem(QGVScene *scene)
+    : _scene(scene)
+{
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption, true);
+}
+
+void QGVBulkItem::setLayout(const QGVLayoutData &layout)
+{
+    prepareGeometryChange();
+    clear();
+
+    Agraph_t *graph = _scene->_graph->graph();
+    QHash<QByteArray, Agnode_t *> nodesByName;
+    QHash<QByteArray, Agedge_t *> edgesByKey;
+    QHash<QByteArray, Agraph_t *> subGraphsByName;
+
+    nodesByName.reserve(agnnodes(graph));
+    for (Agnode_t* node = agfstnode(graph); node != NULL; node = agnxtnode(graph, node))
+        nodesByName.insert(QGVCore::nameOf(node), node);
+
+    const auto keyed = QGVLayoutData::keyedEdges(graph, false);
+    edgesByKey.reserve(keyed.size());
+    for (const auto &edge: keyed)
+        edgesByKey.insert(edge.second, edge.first);
+
+    collect_subgraphs(graph, subGraphsByName);
+
+    const QFont font = _scene->font();
+    QGVLabelCache *labels = _scene->labelCache();
+
+    // Subgraphs
+    Agsym_t *graphStyle = _scene->attributeSymbol(AGRAPH, QGVAttributeKey::Style, false);
+    Agsym_t *graphColor = _scene->attributeSymbol(AGRAPH, QGVAttributeKey::Color, false);
+    Agsym_t *graphFillColor = _scene->attributeSymbol(AGRAPH, QGVAttributeKey::FillColor, false);
+
+    for (const auto &l: layout.subGraphs)
+    {
+        Agraph_t *subgraph = subGraphsByName.value(l.name);
+
+        if (!subgraph)
+            continue;
+
+        const QRectF rect(l.pos, QSizeF(l.width, l.height));
+        _subGraphs.append(subgraph);
+        _subGraphRects.append(rect);
+        _subGraphColors.append(QGVCore::toColor(attribute(subgraph, graphColor)));
+        _subGraphFillColors.append(QGVCore::toColor(attribute(subgraph, graphFillColor)));
+        _subGraphFlags.append(styleFlags(attribute(subgraph, graphStyle)));
+        _subGraphLabels.append(l.label.isEmpty() ? QGVLabelText() : labels->text(l.label, font, Qt::RichText, Qt::AlignCenter));
+        _bounds |= rect;
+    }
+
+    // Nodes
+    Agsym_t *nodeStyle = _scene->attributeSymbol(AGNODE, QGVAttributeKey::Style, false);
+    Agsym_t *nodeColor = _scene->attributeSymbol(AGNODE, QGVAttributeKey::Color, false);
+    Agsym_t *nodeFillColor = _scene->attributeSymbol(AGNODE, QGVAttributeKey::FillColor, false);
+    Agsym_t *nodeLabel = _scene->attributeSymbol(AGNODE, QGVAttributeKey::Label, false);
+
+    _nodes.reserve(layout.nodes.size());
+    _nodeRects.reserve(layout.nodes.size());
+    _nodePaths.reserve(layout.nodes.size());
+    _nodeColors.reserve(layout.nodes.size());
+    _nodeFillColors.reserve(layout.nodes.size());
+    _nodeFlags.reserve(layout.nodes.size());
+    _nodeLabels.reserve(layout.nodes.size());
+    _nodeIndexes.reserve(layout.nodes.size());
+
+    for (const auto &l: layout.nodes)
+    {
+        Agnode_t *node = nodesByName.value(l.name);
+
+        if (!node)
+            continue;
+
+        QString label = attribute(node, nodeLabel);
+        if (label.isEmpty() || label == "\\N")
+            label = QString(l.name);
+
+        const QRectF rect(l.pos, QSizeF(l.width, l.height));
+        _nodeIndexes.insert(node, _nodes.size());
+        _nodes.append(node);
+        _nodeRects.append(rect);
+        _nodePaths.append(l.path.translated(l.pos));
+        _nodeColors.append(QGVCore::toColor(attribute(node, nodeColor)));
+        _nodeFillColors.append(QGVCore::toColor(attribute(node, nodeFillColor)));
+        _nodeFlags.append(styleFlags(attribute(node, nodeStyle)));
+        _nodeLabels.append(labels->text(label, font, Qt::RichText, Qt::AlignCenter));
+        _bounds |= rect;
+    }
+
+    _nodeIndex.build(_nodeRects);
+
+    // Edges
+    Agsym_t *edgeStyle = _scene->attributeSymbol(AGEDGE, QGVAttributeKey::Style, false);
+    Agsym_t *edgeColor = _scene->attributeSymbol(AGEDGE, QGVAttributeKey::Color, false);
+    QVector<QRectF> edgeRects;
+
+    _edges.reserve(layout.edges.size());
+    _edgePaths.reserve(layout.edges.size());
+    _edgePolylines.reserve(layout.edges.size());
+    _edgeHeadArrows.reserve(layout.edges.size());
+    _edgeTailArrows.reserve(layout.edges.size());
+    _edgeColors.reserve(layout.edges.size());
+    _edgeStyles.reserve(layout.edges.size());
+    _edgeFlags.reserve(layout.edges.size());
+    _edgeLabels.reserve(layout.edges.size());
+    _edgeLabelCenters.reserve(layout.edges.size());
+    _edgeIndexes.reserve(layout.edges.size());
+    edgeRects.reserve(layout.edges.size());
+
+    for (const auto &l: layout.edges)
+    {
+        Agedge_t *edge = edgesByKey.value(l.key);
+
+        if (!edge)
+            continue;
+
+        const QString style = attribute(edge, edgeStyle);
+        QRectF rect = l.path.controlPointRect() | l.headArrow.boundingRect() | l.tailArrow.boundingRect();
+
+        if (l.label.valid)
+        {
+            _edgeLabels.append(labels->text(l.label.text, font, Qt::RichText, Qt::AlignCenter));
+            _edgeLabelCenters.append(l.label.center);
+
+            const QSizeF size = _edgeLabels.last().size();
+            rect |= QRectF(l.label.center - QPointF(size.width()/2, size.height()/2), size);
+        }
+        else
+        {
+            _edgeLabels.append(QGVLabelText());
+            _edgeLabelCenters.append(QPointF());
+        }
+
+        _edgeIndexes.insert(edge, _edges.size());
+        _edges.append(edge);
+        _edgePaths.append(l.path);
+        _edgePolylines.append(l.path.toSubpathPolygons());
+        _edgeHeadArrows.append(l.headArrow);
+        _edgeTailArrows.append(l.tailArrow);
+        _edgeColors.append(QGVCore::toColor(attribute(edge, edgeColor)));
+        _edgeStyles.append(QGVCore::toPenStyle(style));
+        _edgeFlags.append(styleFlags(style));
+        edgeRects.append(rect);
+        _bounds |= rect;
+    }
+
+    _edgeIndex.build(edgeRects);
+    update();
+}
+
+void QGVBulkItem::clear()
+{
+    prepareGeometryChange();
+    _bounds = QRectF();
+
+    _nodes.clear();
+    _nodeRects.clear();
+    _nodePaths.clear();
+    _nodeColors.clear();
+    _nodeFillColors.clear();
+    _nodeFlags.clear();
+    _nodeLabels.clear();
+    _nodeIndexes.clear();
+    _nodeIndex.clear();
+
+    _edges.clear();
+    _edgePaths.clear();
+    _edgePolylines.clear();
+    _edgeHeadArrows.clear();
+    _edgeTailArrows.clear();
+    _edgeColors.clear();
+    _edgeStyles.clear();
+    _edgeFlags.clear();
+    _edgeLabels.clear();
+    _edgeLabelCenters.clear();
+    _edgeIndexes.clear();
+    _edgeIndex.clear();
+
+    _subGraphs.clear();
+    _subGraphRects.clear();
+    _subGraphColors.clear();
+    _subGraphFillColors.clear();
+    _subGraphFlags.clear();
+    _subGraphLabels.clear();
+}
+
+void QGVBulkItem::remove(Agnode_t *node)
+{
+    auto it = _nodeIndexes.find(node);
+
+    if (it == _nodeIndexes.end())
+        return;
+
+    _nodeFlags[it.value()] |= Removed;
+    update(_nodeRects[it.value()]);
+    _nodeIndexes.erase(it);
+}
+
+void QGVBulkItem::remove(Agedge_t *edge)
+{
+    auto it = _edgeIndexes.find(edge);
+
+    if (it == _edgeIndexes.end())
+        return;
+
+    _edgeFlags[it.value()] |= Removed;
+    update(_edgePaths[it.value()].controlPointRect());
+    _edgeIndexes.erase(it);
+}
+
+void QGVBulkItem::remove(Agraph_t *subgraph)
+{
+    const int index = _subGraphs.indexOf(subgraph);
+
+    if (index < 0)
+        return;
+
+    _subGraphFlags[index] |= Removed;
+    _subGraphs[index] = nullptr;
+    update(_subGraphRects[index]);
+}
+
+void QGVBulkItem::updateStyle(Agnode_t *node)
+{
+    const int index = _nodeIndexes.value(node, -1);
+
+    if (index < 0)
+        return;
+
+    Agsym_t *style = _scene->attributeSymbol(AGNODE, QGVAttributeKey::Style, false);
+    _nodeColors[index] = QGVCore::toColor(attribute(node, _scene->attributeSymbol(AGNODE, QGVAttributeKey::Color, false)));
+    _nodeFillColors[index] = QGVCore::toColor(attribute(node, _scene->attributeSymbol(AGNODE, QGVAttributeKey::FillColor, false)));
+    _nodeFlags[index] = styleFlags(attribute(node, style));
+    update(_nodeRects[index]);
+}
+
+void QGVBulkItem::updateStyle(Agedge_t *edge)
+{
+    const int index = _edgeIndexes.value(edge, -1);
+
+    if (index < 0)
+        return;
+
+    const QString style = attribute(edge, _scene->attributeSymbol(AGEDGE, QGVAttributeKey::Style, false));
+    _edgeColors[index] = QGVCore::toColor(attribute(edge, _scene->attributeSymbol(AGEDGE, QGVAttributeKey::Color, false)));
+    _edgeStyles[index] = QGVCore::toPenStyle(style);
+    _edgeFlags[index] = styleFlags(style);
+    update(_edgePaths[index].controlPointRect());
+}
+
+void QGVBulkItem::updateStyle(Agraph_t *subgraph)
+{
+    const int index = _subGraphs.indexOf(subgraph);
+
+    if (index < 0)
+        return;
+
+    Agsym_t *style = _scene->attributeSymbol(AGRAPH, QGVAttributeKey::Style, false);
+    _subGraphColors[index] = QGVCore::toColor(attribute(subgraph, _scene->attributeSymbol(AGRAPH, QGVAttributeKey::Color, false)));
+    _subGraphFillColors[index] = QGVCore::toColor(attribute(subgraph, _scene->attributeSymbol(AGRAPH, QGVAttributeKey::FillColor, false)));
+    _subGraphFlags[index] = styleFlags(attribute(subgraph, style));
+    update(_subGraphRects[index]);
+}
+
+Agnode_t *QGVBulkItem::nodeAt(const QPointF &pos) const
+{
+    Agnode_t *result = nullptr;
+    int top = -1;
+
+    _nodeIndex.query(QRectF(pos - QPointF(0.5, 0.5), QSizeF(1, 1)), [&] (int i)
+    {
+        // Later nodes are drawn on top
+        if (i > top && !(_nodeFlags[i] & (Invisible | Removed)) &&
+            (_nodePaths[i].isEmpty() ? _nodeRects[i].contains(pos) : _nodePaths[i].contains(pos)))
+        {
+            top = i;
+            result = _nodes[i];
+        }
+    });
+
+    return result;
+}
+
+Agedge_t *QGVBulkItem::edgeAt(const QPointF &pos) const
+{
+    const QPointF margin(EdgePickDistance, EdgePickDistance);
+    Agedge_t *result = nullptr;
+    qreal best = EdgePickDistance;
+
+    _edgeIndex.query(QRectF(pos - margin, pos + margin), [&] (int i)
+    {
+        if (_edgeFlags[i] & (Invisible | Removed))
+            return;
+
+        for (const auto &polyline: _edgePolylines[i])
+        {
+            for (int p = 1; p < polyline.size(); p++)
+            {
+                const qreal distance = QGVCore::distanceToSegment(pos, polyline[p-1], polyline[p]);
+
+                if (distance <= best)
+                {
+                    best = distance;
+                    result = _edges[i];
+                }
+            }
+        }
+    });
+
+    return result;
+}
+
+Agraph_t *QGVBulkItem::subGraphAt(const QPointF &pos) const
+{
+    // Nested subgraphs come after their parent
+    for (int i = _subGraphs.size() - 1; i >= 0; i--)
+    {
+        if (_subGraphs[i] && !(_subGraphFlags[i] & Invisible) && _subGraphRects[i].contains(pos))
+            return _subGraphs[i];
+    }
+    return nullptr;
+}
+
+QRectF QGVBulkItem::boundingRect() const
+{
+    return _bounds;
+}
+
+void QGVBulkItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *)
+{
+    const QRectF exposed = option->exposedRect;
+    const qreal lod = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform());
+    const bool drawLabels = lod >= _scene->labelDetailThreshold();
+    const bool fullEdges = lod >= _scene->edgeDetailThreshold();
+    const QColor textColor = _scene->palette().color(QPalette::Text);
+    QPen pen;
+
+    painter->save();
+    painter->setFont(_scene->font());
+
+    for (int i = 0; i < _subGraphs.size(); i++)
+    {
+        if (!_subGraphs[i] || (_subGraphFlags[i] & Invisible) || !_subGraphRects[i].intersects(exposed))
+            continue;
+
+        pen.setColor(_subGraphColors[i]);
+        painter->setPen(pen);
+        painter->setBrush(_subGraphFlags[i] & Filled ? QBrush(_subGraphFillColors[i]) : QBrush());
+        painter->drawRect(_subGraphRects[i]);
+
+        if (drawLabels)
+        {
+            const QRectF &rect = _subGraphRects[i];
+            const qreal height = _subGraphLabels[i].size().height();
+            draw_label(painter, QPointF(rect.center().x(), rect.top() + height/2), _subGraphLabels[i], textColor);
+        }
+    }
+
+    if (fullEdges || !_scene->hideLowDetailEdges())
+    {
+        _edgeIndex.query(exposed, [&] (int i)
+        {
+            if (_edgeFlags[i] & (Invisible | Removed))
+                return;
+
+            pen.setColor(_edgeColors[i]);
+            pen.setStyle(_edgeStyles[i]);
+            painter->setPen(pen);
+
+            if (fullEdges)
+            {
+                painter->setBrush(Qt::NoBrush);
+                painter->drawPath(_edgePaths[i]);
+                painter->setBrush(_edgeColors[i]);
+                painter->drawPolygon(_edgeHeadArrows[i]);
+                painter->drawPolygon(_edgeTailArrows[i]);
+
+                if (drawLabels)
+                {
+                    draw_label(painter, _edgeLabelCenters[i], _edgeLabels[i], textColor);
+                }
+            }
+            else if (!_edgePaths[i].isEmpty())
+                painter->drawLine(_edgePaths[i].elementAt(0), _edgePaths[i].currentPosition());
+        });
+    }
+
+    pen.setStyle(Qt::SolidLine);
+
+    _nodeIndex.query(exposed, [&] (int i)
+    {
+        if (_nodeFlags[i] & (Invisible | Removed))
+            return;
+
+        const QColor fill = _nodeFlags[i] & Filled ? _nodeFillColors[i] : QColor();
+
+        if (!drawLabels)
+        {
+            painter->fillRect(_nodeRects[i], fill.isValid() ? fill : _nodeColors[i]);
+            return;
+        }
+
+        pen.setColor(_nodeColors[i]);
+        painter->setPen(pen);
+        painter->setBrush(fill.isValid() ? QBrush(fill) : QBrush());
+        painter->drawPath(_nodePaths[i]);
+
+        draw_label(painter, _nodeRects[i].center(), _nodeLabels[i], textColor);
+    });
+
+    painter->restore();
+}
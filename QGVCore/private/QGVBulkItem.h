@@ -0,0 +1,118 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#ifndef QGVBULKITEM_H
+#define QGVBULKITEM_H
+
+#include <QColor>
+#include <QGraphicsItem>
+#include <QHash>
+#include <QPainterPath>
+#include <QPen>
+#include <QVector>
+#include <cgraph.h>
+
+#include "QGVLabelItem.h"
+#include "QGVSpatialIndex.h"
+
+class QGVScene;
+struct QGVLayoutData;
+
+/**
+ * @brief Draws a whole laid out graph as a single item
+ *
+ * Used by QGVScene in bulk rendering mode. The geometry and styles of all
+ * nodes, edges and subgraphs are kept in flat arrays, indexed by an R-tree
+ * for culling and picking, instead of in one QGraphicsItem per element.
+ */
+class QGVBulkItem : public QGraphicsItem
+{
+public:
+    explicit QGVBulkItem(QGVScene *scene);
+
+    // Replaces the drawn graph. Objects are matched to the scene graph by
+    // name, objects missing from it are skipped.
+    void setLayout(const QGVLayoutData &layout);
+    void clear();
+
+    // Stops drawing an object deleted from the scene graph.
+    void remove(Agnode_t *node);
+    void remove(Agedge_t *edge);
+    void remove(Agraph_t *subgraph);
+
+    // Rereads the colors and style of an object after an attribute change.
+    void updateStyle(Agnode_t *node);
+    void updateStyle(Agedge_t *edge);
+    void updateStyle(Agraph_t *subgraph);
+
+    // Topmost object at the scene position, null if there is none.
+    Agnode_t *nodeAt(const QPointF &pos) const;
+    Agedge_t *edgeAt(const QPointF &pos) const;
+    Agraph_t *subGraphAt(const QPointF &pos) const;
+
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
+
+private:
+    enum Flags
+    {
+        Filled = 0x1,
+        Invisible = 0x2,
+        Removed = 0x4
+    };
+
+    static quint8 styleFlags(const QString &style);
+
+    QGVScene *_scene;
+    QRectF _bounds;
+
+    // Nodes, in scene coordinates
+    QVector<Agnode_t *> _nodes;
+    QVector<QRectF> _nodeRects;
+    QVector<QPainterPath> _nodePaths;
+    QVector<QColor> _nodeColors;
+    QVector<QColor> _nodeFillColors;
+    QVector<quint8> _nodeFlags;
+    QVector<QGVLabelText> _nodeLabels;
+    QHash<Agnode_t *, int> _nodeIndexes;
+    QGVSpatialIndex _nodeIndex;
+
+    // Edges
+    QVector<Agedge_t *> _edges;
+    QVector<QPainterPath> _edgePaths;
+    // Flattened paths for picking
+    QVector<QList<QPolygonF>> _edgePolylines;
+    QVector<QPolygonF> _edgeHeadArrows;
+    QVector<QPolygonF> _edgeTailArrows;
+    QVector<QColor> _edgeColors;
+    QVector<Qt::PenStyle> _edgeStyles;
+    QVector<quint8> _edgeFlags;
+    QVector<QGVLabelText> _edgeLabels;
+    QVector<QPointF> _edgeLabelCenters;
+    QHash<Agedge_t *, int> _edgeIndexes;
+    QGVSpatialIndex _edgeIndex;
+
+    // Subgraphs, few enough to be scanned
+    QVector<Agraph_t *> _subGraphs;
+    QVector<QRectF> _subGraphRects;
+    QVector<QColor> _subGraphColors;
+    QVector<QColor> _subGraphFillColors;
+    QVector<quint8> _subGraphFlags;
+    QVector<QGVLabelText> _subGraphLabels;
+};
+
+#endif // QGVBULKITEM_H
@@ -16,11 +16,18 @@ You should have received a copy of the GNU Lesser General Public
 License along with this library.
 ***************************************************************/
 #include "QGVCore.h"
+#include "QGVGvcPrivate.h"
 #include <QDebug>
+#include <QMutexLocker>
+#include <QVector>
+#include <QtMath>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
 
 qreal QGVCore::graphHeight(Agraph_t *graph)
 {
-    //Hauteur totale du graphique (permet d'effectuer le calcul inverse des coordonnes)
+    //Hauteur totale du graphique (permet d'effectuer le calcul inverse des coordonnées)
     return GD_bb(graph).UR.y;
 }
 
@@ -36,6 +43,13 @@ QPointF QGVCore::toPoint(point p, qreal gheight)
     return QPointF(p.x, gheight - p.y);
 }
 
+QPointF QGVCore::toPoint(pointf p, const boxf &bb)
+{
+    // Not every engine translates its output to the origin (e.g. neato with
+    // notranslate or pinned positions), map the bounding box to the origin.
+    return QPointF(p.x - bb.LL.x, bb.UR.y - p.y);
+}
+
 QPointF QGVCore::centerToOrigin(const QPointF &p, qreal width, qreal height)
 {
     //L'origine d'un objet est le centre dans graphViz et du haut gauche pour Qt !
@@ -59,55 +73,97 @@ QPolygonF QGVCore::toPolygon(const polygon_t *poly, qreal width, qreal height)
 QPainterPath QGVCore::toPath(const char *type, const polygon_t *poly, qreal width, qreal height)
 {
     QPainterPath path;
-    if ((strcmp(type, "rectangle") == 0) ||
-        (strcmp(type, "box") == 0) ||
-        (strcmp(type, "hexagon") == 0) ||
-        (strcmp(type, "polygon") == 0) ||
-        (strcmp(type, "diamond") == 0))
+    if ((strcmp(type, "plaintext") == 0) ||
+        (strcmp(type, "plain") == 0) ||
+        (strcmp(type, "none") == 0))
     {
-        QPolygonF polygon = toPolygon(poly, width, height);
-        polygon.append(polygon[0]);
-        path.addPolygon(polygon);
+        // label only
+    }
+    else if ((strcmp(type, "record") == 0) ||
+             (strcmp(type, "Mrecord") == 0))
+    {
+        // shape_info is a field_t, not a polygon
+        path.addRect(0, 0, width, height);
+    }
+    else if (!poly)
+    {
+        qWarning("unsupported shape %s", type);
     }
-    else if ((strcmp(type, "ellipse") == 0) ||
-            (strcmp(type, "circle") == 0))
+    else if (poly->sides >= 3)
     {
+        // box, polygon, diamond, hexagon, ...
         QPolygonF polygon = toPolygon(poly, width, height);
-        path.addEllipse(QRectF(polygon[0], polygon[1]));
+        polygon.append(polygon[0]);
+        path.addPolygon(polygon);
     }
     else
     {
-        qWarning("unsupported shape %s", type);
+        // ellipse, circle, point, ...
+        path.addEllipse(QRectF(0, 0, width, height));
     }
     return path;
 }
 
-QPainterPath QGVCore::toPath(const splines *spl, qreal gheight)
+QPainterPath QGVCore::toPath(const splines *spl, const boxf &bb)
 {
     QPainterPath path;
-    if((spl->list != 0) && (spl->list->size%3 == 1))
+
+    // No splines at all with splines=none or splines=""
+    if (!spl)
+        return path;
+
+    // Compound edges and some engines produce more than one bezier
+    for (int b = 0; b < spl->size; b++)
     {
-        bezier bez = spl->list[0];
+        const bezier &bez = spl->list[b];
+
+        if (bez.size%3 != 1)
+            continue;
+
         //If there is a starting point, draw a line from it to the first curve point
         if(bez.sflag)
         {
-            path.moveTo(toPoint(bez.sp, gheight));
-            path.lineTo(toPoint(bez.list[0], gheight));
+            path.moveTo(toPoint(bez.sp, bb));
+            path.lineTo(toPoint(bez.list[0], bb));
         }
         else
-            path.moveTo(toPoint(bez.list[0], gheight));
+            path.moveTo(toPoint(bez.list[0], bb));
 
         //Loop over the curve points
         for(int i=1; i<bez.size; i+=3)
-            path.cubicTo(toPoint(bez.list[i], gheight), toPoint(bez.list[i+1], gheight), toPoint(bez.list[i+2], gheight));
+            path.cubicTo(toPoint(bez.list[i], bb), toPoint(bez.list[i+1], bb), toPoint(bez.list[i+2], bb));
 
         //If there is an ending point, draw a line to it
         if(bez.eflag)
-            path.lineTo(toPoint(bez.ep, gheight));
+            path.lineTo(toPoint(bez.ep, bb));
     }
     return path;
 }
 
+QPolygonF QGVCore::toArrow(const QLineF &line)
+{
+    QLineF n = line.normalVector();
+    QPointF o(n.dx() / 3.0, n.dy() / 3.0);
+
+    //Only support normal arrow type
+    QPolygonF polygon;
+    polygon.append(line.p1() + o);
+    polygon.append(line.p2());
+    polygon.append(line.p1() - o);
+
+    return polygon;
+}
+
+qreal QGVCore::distanceToSegment(const QPointF &p, const QPointF &a, const QPointF &b)
+{
+    const QPointF ab = b - a;
+    const qreal length = QPointF::dotProduct(ab, ab);
+    qreal t = length > 0 ? QPointF::dotProduct(p - a, ab) / length : 0.0;
+    t = qBound<qreal>(0.0, t, 1.0);
+    const QPointF d = p - (a + t*ab);
+    return qSqrt(QPointF::dotProduct(d, d));
+}
+
 Qt::BrushStyle QGVCore::toBrushStyle(const QString &style)
 {
     if(style == "filled")
@@ -124,7 +180,202 @@ Qt::PenStyle QGVCore::toPenStyle(const QString &style)
     return Qt::SolidLine;
 }
 
+qreal QGVCore::toPenWidth(const QString &width)
+{
+    bool ok = false;
+    const qreal result = width.toDouble(&ok);
+    return ok && result >= 0 ? result : 1.0;
+}
+
 QColor QGVCore::toColor(const QString &color)
 {
     return QColor(color);
 }
+
+bool QGVCore::isInvisible(const QString &style)
+{
+    return style.compare("invis", Qt::CaseInsensitive) == 0;
+}
+
+QByteArray QGVCore::nameOf(void *object, bool locked)
+{
+    // The default id discipline gives anonymous objects odd ids. Out-edges
+    // have no generated names.
+    if (locked || AGTYPE(object) == AGOUTEDGE || !(AGID(object) & 1))
+        return agnameof(object);
+
+    QMutexLocker locker(&QGVGvcPrivate::mutex());
+    return agnameof(object);
+}
+
+int QGVCore::attributeEffect(const QGVAttributeKey &key)
+{
+    // Indexed by key id
+    static const QVector<quint8> effects = [] ()
+    {
+        QVector<quint8> result;
+
+        auto add = [&result] (std::initializer_list<const char *> names, quint8 effect)
+        {
+            for (auto name: names)
+            {
+                const int id = QGVAttributeKey(name).id();
+                if (id >= result.size())
+                    result.resize(id + 1);
+                result[id] |= effect;
+            }
+        };
+
+        add({ "label", "color", "fillcolor", "pencolor", "bgcolor", "fontcolor", "labelfontcolor", "penwidth",
+              "style", "colorscheme", "gradientangle", "tooltip", "labeltooltip", "headtooltip", "tailtooltip",
+              "edgetooltip", "URL", "href", "target", "id", "class", "comment" }, StyleEffect);
+
+        add({ "label", "xlabel", "headlabel", "taillabel", "shape", "width", "height", "fixedsize", "fontname",
+              "fontsize", "labelfontname", "labelfontsize", "margin", "peripheries", "sides", "regular",
+              "orientation", "distortion", "skew", "image", "imagescale", "labelloc", "labeljust", "nojustify",
+              "labelangle", "labeldistance", "labelfloat", "rankdir", "rank", "ranksep", "nodesep", "newrank",
+              "clusterrank", "compound", "concentrate", "ordering", "splines", "overlap", "sep", "esep", "size",
+              "ratio", "pad", "dpi", "headport", "tailport", "samehead", "sametail", "lhead", "ltail", "weight",
+              "minlen", "constraint", "group", "dir", "arrowhead", "arrowtail", "arrowsize", "len", "pos", "pin",
+              "K", "root", "mode", "model", "start", "maxiter", "nslimit", "nslimit1", "mclimit", "searchsize",
+              "inputscale", "layout", "dim", "dimen" }, LayoutEffect);
+
+        return result;
+    }();
+
+    return effects.value(key.id());
+}
+
+namespace
+{
+Agiodisc_t make_io_disc(int (*afread)(void *chan, char *buf, int bufsize))
+{
+    Agiodisc_t disc;
+    disc.afread = afread;
+    disc.putstr = AgIoDisc.putstr;
+    disc.flush = AgIoDisc.flush;
+    return disc;
+}
+
+int no_flush(void *)
+{
+    return 0;
+}
+
+Agiodisc_t make_output_disc(int (*putstr)(void *chan, const char *str))
+{
+    Agiodisc_t disc;
+    disc.afread = AgIoDisc.afread;
+    disc.putstr = putstr;
+    disc.flush = no_flush;
+    return disc;
+}
+
+bool write_graph(Agraph_t *graph, void *chan, Agiodisc_t *disc)
+{
+    // agwrite() always uses the io discipline of the graph. Swap it for the
+    // duration of the call.
+    Agiodisc_t *saved = AGDISC(graph, io);
+    AGDISC(graph, io) = disc;
+    const int rv = agwrite(graph, chan);
+    AGDISC(graph, io) = saved;
+    return rv != EOF;
+}
+
+Agraph_t *read_graph(void *chan, Agiodisc_t *io)
+{
+    // The graph keeps a pointer to the io discipline, the Agdisc_t itself is
+    // copied.
+    Agdisc_t disc = {};
+    disc.id = &AgIdDisc;
+    disc.io = io;
+    return agread(chan, &disc);
+}
+}
+
+int QGVCore::memiofread(void *chan, char *buf, int bufsize)
+{
+    rdr_t *s = (rdr_t *) chan;
+
+    if (bufsize == 0 || s->cur >= s->len)
+        return 0;
+
+    const char *ptr = s->data + s->cur;
+    qint64 l = qMin<qint64>(bufsize, s->len - s->cur);
+
+    if (auto eol = static_cast<const char *>(std::memchr(ptr, '\n', l)))
+        l = eol - ptr + 1;
+
+    std::memcpy(buf, ptr, l);
+    s->cur += l;
+    return l;
+}
+
+int QGVCore::deviceiofread(void *chan, char *buf, int bufsize)
+{
+    auto device = static_cast<QIODevice *>(chan);
+
+    // readLine() needs room for the terminating null byte
+    if (bufsize < 2)
+        return 0;
+
+    qint64 l = device->readLine(buf, bufsize);
+
+    while (l <= 0 && device->isSequential() && device->waitForReadyRead(QGVCore::DeviceReadTimeout))
+        l = device->readLine(buf, bufsize);
+
+    if (l <= 0 && device->isSequential() && !device->atEnd())
+        qWarning() << "Timed out reading graph from" << device;
+
+    return l < 0 ? 0 : l;
+}
+
+Agraph_t *QGVCore::agmemread2(const char *cp)
+{
+    return agmemread2(cp, std::strlen(cp));
+}
+
+Agraph_t *QGVCore::agmemread2(const char *data, qint64 len)
+{
+    static Agiodisc_t memIoDisc = make_io_disc(memiofread);
+
+    rdr_t rdr;
+    rdr.data = data;
+    rdr.len = len;
+    rdr.cur = 0;
+
+    return read_graph(&rdr, &memIoDisc);
+}
+
+Agraph_t *QGVCore::agdevread(QIODevice *device)
+{
+    static Agiodisc_t deviceIoDisc = make_io_disc(deviceiofread);
+
+    return read_graph(device, &deviceIoDisc);
+}
+
+int QGVCore::bytearrayputstr(void *chan, const char *str)
+{
+    static_cast<QByteArray *>(chan)->append(str);
+    return 0;
+}
+
+int QGVCore::deviceputstr(void *chan, const char *str)
+{
+    const qint64 len = std::strlen(str);
+    return static_cast<QIODevice *>(chan)->write(str, len) == len ? 0 : EOF;
+}
+
+bool QGVCore::agmemwrite(Agraph_t *graph, QByteArray *dest)
+{
+    static Agiodisc_t memIoDisc = make_output_disc(bytearrayputstr);
+
+    return write_graph(graph, dest, &memIoDisc);
+}
+
+bool QGVCore::agdevwrite(Agraph_t *graph, QIODevice *device)
+{
+    static Agiodisc_t deviceIoDisc = make_output_disc(deviceputstr);
+
+    return write_graph(graph, device, &deviceIoDisc);
+}
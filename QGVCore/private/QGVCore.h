@@ -22,7 +22,10 @@ License along with this library.
 #include <QPointF>
 #include <QPolygonF>
 #include <QPainterPath>
+#include <QLineF>
 #include <QColor>
+#include <QIODevice>
+#include <QGVAttribute.h>
 
 //GraphViz headers
 #include <gvc.h>
@@ -40,64 +43,68 @@ public:
     static qreal graphHeight(Agraph_t *graph);
     static QPointF toPoint(pointf p, qreal gheight);
     static QPointF toPoint(point p, qreal gheight);
+    static QPointF toPoint(pointf p, const boxf &bb);
     static QPointF centerToOrigin(const QPointF &p, qreal width, qreal height);
     static QPolygonF toPolygon(const polygon_t* poly, qreal width, qreal height);
 
     static QPainterPath toPath(const char *type, const polygon_t *poly, qreal width, qreal height);
-    static QPainterPath toPath(const splines* spl, qreal gheight);
+    static QPainterPath toPath(const splines* spl, const boxf &bb);
+    static QPolygonF toArrow(const QLineF &line);
+    static qreal distanceToSegment(const QPointF &p, const QPointF &a, const QPointF &b);
 
     static Qt::BrushStyle toBrushStyle(const QString &style);
     static Qt::PenStyle toPenStyle(const QString &style);
+    // penwidth in points, 1 if unset or invalid as in Graphviz
+    static qreal toPenWidth(const QString &width);
     static QColor toColor(const QString &color);
+    static bool isInvisible(const QString &style);
+
+    // What changing an attribute affects. Style attributes only change how
+    // the items are drawn, layout attributes need a relayout. A label is
+    // both. Unknown attributes have no effect.
+    enum AttributeEffect
+    {
+        NoEffect = 0x0,
+        StyleEffect = 0x1,
+        LayoutEffect = 0x2
+    };
+
+    static int attributeEffect(const QGVAttributeKey &key);
+
+    // Copy of agnameof(). Only the names of anonymous nodes and subgraphs
+    // are formatted into agnameof()'s static buffer, the global Graphviz
+    // lock is taken for those unless the caller already holds it. Named
+    // objects are looked up in their own graph, so the GUI thread does not
+    // wait for layouts of other graphs running in the background.
+    static QByteArray nameOf(void *object, bool locked = false);
 
     typedef struct {
         const char *data;
-        int len;
-        int cur;
+        qint64 len;
+        qint64 cur;
     } rdr_t;
 
-    static int memiofread(void *chan, char *buf, int bufsize)
-    {
-        const char *ptr;
-        char *optr;
-        char c;
-        int l;
-        rdr_t *s;
-
-        if (bufsize == 0) return 0;
-        s = (rdr_t *) chan;
-        if (s->cur >= s->len)
-            return 0;
-        l = 0;
-        ptr = s->data + s->cur;
-        optr = buf;
-        do {
-            *optr++ = c = *ptr++;
-            l++;
-        } while (c && (c != '\n') && (l < bufsize));
-        s->cur += l;
-        return l;
-    }
-
-    static Agraph_t *agmemread2(const char *cp)
-    {
-        Agraph_t* g;
-        rdr_t rdr;
-        Agdisc_t disc;
-        Agiodisc_t memIoDisc;
-
-        memIoDisc.afread = memiofread;
-        memIoDisc.putstr = AgIoDisc.putstr;
-        memIoDisc.flush = AgIoDisc.flush;
-        rdr.data = cp;
-        rdr.len = strlen(cp);
-        rdr.cur = 0;
-
-        disc.id = &AgIdDisc;
-        disc.io = &memIoDisc;
-        g = agread (&rdr, &disc);
-        return g;
-    }
+    // Agiodisc_t.afread implementations handing the input to cgraph line by
+    // line. chan is a rdr_t for memiofread and a QIODevice for deviceiofread.
+    // deviceiofread ends the input if a sequential device has no data for
+    // DeviceReadTimeout ms, callers should buffer those, see
+    // QGVScene::loadLayout().
+    static const int DeviceReadTimeout = 30000;
+    static int memiofread(void *chan, char *buf, int bufsize);
+    static int deviceiofread(void *chan, char *buf, int bufsize);
+
+    static Agraph_t *agmemread2(const char *cp);
+    static Agraph_t *agmemread2(const char *data, qint64 len);
+    static Agraph_t *agdevread(QIODevice *device);
+
+    // Agiodisc_t.putstr implementations. chan is a QByteArray for
+    // bytearrayputstr and a QIODevice for deviceputstr.
+    static int bytearrayputstr(void *chan, const char *str);
+    static int deviceputstr(void *chan, const char *str);
+
+    // agwrite() replacements writing to memory or a device instead of a FILE.
+    static bool agmemwrite(Agraph_t *graph, QByteArray *dest);
+    static bool agdevwrite(Agraph_t *graph, QIODevice *device);
 };
 
 #endif // QGVCORE_H
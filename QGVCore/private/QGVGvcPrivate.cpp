@@ -1,4 +1,40 @@
 #include "QGVGvcPrivate.h"
+#include <QElapsedTimer>
+#include <QMutexLocker>
+
+#ifdef QGV_BUILTIN_GRAPHVIZ_PLUGINS
+#include <gvplugin.h>
+
+extern "C"
+{
+	extern gvplugin_library_t gvplugin_dot_layout_LTX_library;
+	extern gvplugin_library_t gvplugin_neato_layout_LTX_library;
+}
+#endif
+
+namespace
+{
+GVC_t *sharedContext = NULL;
+int sharedContextRefs = 0;
+qint64 sharedContextCreationTime = 0;
+
+GVC_t *create_context()
+{
+#ifdef QGV_BUILTIN_GRAPHVIZ_PLUGINS
+	// Only the layout engines QGVScene offers, linked in. Skips scanning the
+	// plugin directory and parsing its config file.
+	static lt_symlist_t builtins[] =
+	{
+		{ "gvplugin_dot_layout_LTX_library", &gvplugin_dot_layout_LTX_library },
+		{ "gvplugin_neato_layout_LTX_library", &gvplugin_neato_layout_LTX_library },
+		{ 0, 0 }
+	};
+	return gvContextPlugins(builtins, 0);
+#else
+	return gvContext();
+#endif
+}
+}
 
 QGVGvcPrivate::QGVGvcPrivate(GVC_t *context)
 {
@@ -14,3 +50,36 @@ GVC_t* QGVGvcPrivate::context() const
 {
 	return _context;
 }
+
+QMutex &QGVGvcPrivate::mutex()
+{
+	static QMutex mutex;
+	return mutex;
+}
+
+GVC_t *QGVGvcPrivate::acquireContext()
+{
+	if (sharedContextRefs++ == 0)
+	{
+		QElapsedTimer timer;
+		timer.start();
+		sharedContext = create_context();
+		sharedContextCreationTime = timer.nsecsElapsed();
+	}
+	return sharedContext;
+}
+
+void QGVGvcPrivate::releaseContext()
+{
+	if (sharedContextRefs > 0 && --sharedContextRefs == 0)
+	{
+		gvFreeContext(sharedContext);
+		sharedContext = NULL;
+	}
+}
+
+qint64 QGVGvcPrivate::contextCreationTime()
+{
+	QMutexLocker locker(&mutex());
+	return sharedContextCreationTime;
+}
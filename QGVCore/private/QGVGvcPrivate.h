@@ -2,8 +2,10 @@
 #define QGVGVCPRIVATE_H
 
 #include <gvc.h>
+#include <QMutex>
+#include "qgv_export.h"
 
-class QGVGvcPrivate
+class QGVCORE_PRIVATE_EXPORT QGVGvcPrivate
 {
 	public:
 		QGVGvcPrivate(GVC_t *context = NULL);
@@ -11,6 +13,21 @@ class QGVGvcPrivate
 		void setContext(GVC_t *context);
 		GVC_t* context() const;
 
+		// Graphviz keeps global state (parser, layout engines, error
+		// buffers). Calls that may run concurrently with a layout worker
+		// thread have to hold this lock.
+		static QMutex &mutex();
+
+		// Process wide context shared by all scenes and layout jobs. Created
+		// on the first acquire and freed with the last release. Both have to
+		// be called with mutex() held.
+		static GVC_t *acquireContext();
+		static void releaseContext();
+
+		// Time the last gvContext() creation took in nanoseconds, 0 if no
+		// context was created yet.
+		static qint64 contextCreationTime();
+
 		// operators to implicit cast from QGVGvcPrivate* into GVC_t* seems not to work,
 		// because of typedef GVC_t
 //		inline operator const GVC_t* () const
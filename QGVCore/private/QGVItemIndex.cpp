@@ -0,0 +1,123 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#include "QGVItemIndex.h"
+#include <QGVEdge.h>
+#include <algorithm>
+
+void QGVItemIndex::build(const QList<QGraphicsItem *> &items)
+{
+    clear();
+
+    QVector<QRectF> rects;
+    rects.reserve(items.size());
+    _owners.reserve(items.size());
+    _items.reserve(items.size());
+
+    for (auto item: items)
+    {
+        const int owner = _items.size();
+        _items.append(item);
+
+        if (item->type() == QGVEdge::Type)
+        {
+            auto edge = static_cast<QGVEdge *>(item);
+            const QTransform transform = edge->sceneTransform();
+
+            for (const auto &rect: edge->segmentRects())
+            {
+                rects.append(transform.mapRect(rect));
+                _owners.append(owner);
+            }
+        }
+        else
+        {
+            rects.append(item->sceneBoundingRect());
+            _owners.append(owner);
+        }
+    }
+
+    _index.build(rects);
+}
+
+void QGVItemIndex::clear()
+{
+    _index.clear();
+    _owners.clear();
+    _items.clear();
+}
+
+QVector<int> QGVItemIndex::candidates(const QRectF &rect) const
+{
+    QVector<int> result;
+    _index.query(rect, [this, &result] (int entry) { result.append(_owners[entry]); });
+
+    // Edges may be found through several of their segments.
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+QList<QGraphicsItem *> QGVItemIndex::sorted(QVector<int> &hits) const
+{
+    // The indexed items are top level, stacked by z value and then by
+    // insertion order.
+    std::sort(hits.begin(), hits.end(), [this] (int a, int b)
+    {
+        const qreal za = _items[a]->zValue();
+        const qreal zb = _items[b]->zValue();
+        return za != zb ? za > zb : a > b;
+    });
+
+    QList<QGraphicsItem *> result;
+    result.reserve(hits.size());
+
+    for (int i: hits)
+        result.append(_items[i]);
+
+    return result;
+}
+
+QList<QGraphicsItem *> QGVItemIndex::items(const QPointF &pos) const
+{
+    QVector<int> hits = candidates(QRectF(pos - QPointF(0.5, 0.5), QSizeF(1, 1)));
+
+    auto end = std::remove_if(hits.begin(), hits.end(), [this, &pos] (int i)
+    {
+        const QGraphicsItem *item = _items[i];
+        return !item->isVisible() || !item->contains(item->mapFromScene(pos));
+    });
+    hits.erase(end, hits.end());
+
+    return sorted(hits);
+}
+
+QList<QGraphicsItem *> QGVItemIndex::items(const QRectF &rect, Qt::ItemSelectionMode mode) const
+{
+    QVector<int> hits = candidates(rect.normalized().adjusted(-0.5, -0.5, 0.5, 0.5));
+    QPainterPath path;
+    path.addRect(rect);
+
+    auto end = std::remove_if(hits.begin(), hits.end(), [this, &path, mode] (int i)
+    {
+        const QGraphicsItem *item = _items[i];
+        return !item->isVisible() || !item->collidesWithPath(item->mapFromScene(path), mode);
+    });
+    hits.erase(end, hits.end());
+
+    return sorted(hits);
+}
@@ -0,0 +1,61 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#ifndef QGVITEMINDEX_H
+#define QGVITEMINDEX_H
+
+#include <QGraphicsItem>
+#include <QList>
+#include <QVector>
+
+#include "QGVSpatialIndex.h"
+
+/**
+ * @brief Point and rectangle queries over the node, edge and subgraph items
+ *
+ * Edges are stored as one box per path segment instead of their bounding
+ * rectangle, which for long edges covers large parts of the scene. Built in
+ * bulk from the current item geometry, the index is not updated when items
+ * move or change.
+ */
+class QGVItemIndex
+{
+public:
+    void build(const QList<QGraphicsItem *> &items);
+    void clear();
+
+    bool isEmpty() const
+    {
+        return _items.isEmpty();
+    }
+
+    // Same results as QGraphicsScene::items() restricted to the indexed
+    // items, topmost first.
+    QList<QGraphicsItem *> items(const QPointF &pos) const;
+    QList<QGraphicsItem *> items(const QRectF &rect, Qt::ItemSelectionMode mode) const;
+
+private:
+    // Indexes of the items with an entry intersecting rect, without duplicates
+    QVector<int> candidates(const QRectF &rect) const;
+    QList<QGraphicsItem *> sorted(QVector<int> &hits) const;
+
+    QGVSpatialIndex _index;
+    QVector<int> _owners;   // entry to item index
+    QVector<QGraphicsItem *> _items;
+};
+
+#endif // QGVITEMINDEX_H
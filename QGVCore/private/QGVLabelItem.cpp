@@ -0,0 +1,151 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#include "QGVLabelItem.h"
+#include <QAbstractTextDocumentLayout>
+#include <QGVScene.h>
+#include <QPainter>
+#include <QRegularExpression>
+#include <QStyleOptionGraphicsItem>
+#include <QTextDocument>
+
+namespace
+{
+// Default QTextDocument margin, keeps the label placement of QGraphicsTextItem
+const qreal DocumentMargin = 4.0;
+
+// Block elements of HTML-like labels that QStaticText does not lay out
+bool has_blocks(const QString &text)
+{
+    static const QRegularExpression blocks(QStringLiteral("<\\s*(table|hr|vr|img)\\b"),
+                                           QRegularExpression::CaseInsensitiveOption);
+    return text.contains(blocks);
+}
+}
+
+QSizeF QGVLabelText::size() const
+{
+    if (_document)
+        return _document->size();
+
+    if (_text.text().isEmpty())
+        return QSizeF();
+
+    return _text.size() + QSizeF(2*DocumentMargin, 2*DocumentMargin);
+}
+
+void QGVLabelText::draw(QPainter *painter, const QPointF &pos, const QColor &color) const
+{
+    if (_document)
+    {
+        QAbstractTextDocumentLayout::PaintContext context;
+        context.palette.setColor(QPalette::Text, color);
+
+        painter->save();
+        painter->translate(pos);
+        _document->documentLayout()->draw(painter, context);
+        painter->restore();
+        return;
+    }
+
+    if (_text.text().isEmpty())
+        return;
+
+    painter->setPen(color);
+    painter->drawStaticText(pos + QPointF(DocumentMargin, DocumentMargin), _text);
+}
+
+QGVLabelText QGVLabelCache::text(const QString &text, const QFont &font, Qt::TextFormat format, Qt::Alignment alignment)
+{
+    const QString key = font.key() + QLatin1Char('\x1f') + QString::number(format) + QLatin1Char('\x1f')
+                        + QString::number(alignment) + QLatin1Char('\x1f') + text;
+
+    auto it = _texts.constFind(key);
+
+    if (it != _texts.constEnd())
+        return it.value();
+
+    QGVLabelText result;
+    QTextOption option;
+    option.setAlignment(alignment);
+    option.setWrapMode(QTextOption::NoWrap);
+
+    if (format != Qt::PlainText && has_blocks(text))
+    {
+        auto document = new QTextDocument;
+        document->setDefaultFont(font);
+        document->setDefaultTextOption(option);
+        document->setDocumentMargin(DocumentMargin);
+        document->setHtml(text);
+        document->adjustSize();
+        result._document.reset(document);
+    }
+    else
+    {
+        result._text.setTextOption(option);
+        result._text.setTextFormat(format);
+        result._text.setText(text);
+        result._text.prepare(QTransform(), font);
+    }
+
+    ++_parsed;
+    _texts.insert(key, result);
+    return result;
+}
+
+QGVLabelItem::QGVLabelItem(QGVScene *scene, QGraphicsItem *parent)
+    : QGraphicsItem(parent)
+    , _scene(scene)
+{
+}
+
+void QGVLabelItem::setText(const QString &text, Qt::TextFormat format, Qt::Alignment alignment)
+{
+    prepareGeometryChange();
+    _font = _scene->font();
+    _text = text.isEmpty() ? QGVLabelText() : _scene->labelCache()->text(text, _font, format, alignment);
+}
+
+void QGVLabelItem::setColor(const QColor &color)
+{
+    const QColor value = color.isValid() ? color : QColor(Qt::black);
+
+    if (value != _color)
+    {
+        _color = value;
+        update();
+    }
+}
+
+void QGVLabelItem::setCenter(const QPointF &center)
+{
+    setPos(center - boundingRect().center());
+}
+
+QRectF QGVLabelItem::boundingRect() const
+{
+    return QRectF(QPointF(0, 0), _text.size());
+}
+
+void QGVLabelItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *)
+{
+    if (isEmpty() || QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform()) < _scene->labelDetailThreshold())
+        return;
+
+    painter->setFont(_font);
+    _text.draw(painter, QPointF(0, 0), _color);
+}
@@ -0,0 +1,124 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#ifndef QGVLABELITEM_H
+#define QGVLABELITEM_H
+
+#include <QColor>
+#include <QFont>
+#include <QGraphicsItem>
+#include <QHash>
+#include <QSharedPointer>
+#include <QStaticText>
+
+class QGVScene;
+class QTextDocument;
+
+/**
+ * @brief Laid out label text
+ *
+ * A prepared QStaticText for labels of inline rich text. QStaticText cannot
+ * lay out tables and other block elements of HTML-like labels, those keep
+ * a QTextDocument instead. The size includes the document margin.
+ */
+class QGVLabelText
+{
+public:
+    bool isEmpty() const
+    {
+        return !_document && _text.text().isEmpty();
+    }
+
+    QSizeF size() const;
+    // Draws the text with the top left corner of its margin at pos
+    void draw(QPainter *painter, const QPointF &pos, const QColor &color) const;
+
+private:
+    friend class QGVLabelCache;
+
+    QStaticText _text;
+    QSharedPointer<QTextDocument> _document;
+};
+
+/**
+ * @brief Laid out label texts shared by all labels of a scene
+ *
+ * Labels with the same text, font, format and alignment share one laid out
+ * QGVLabelText instead of each parsing and laying out its own document.
+ */
+class QGVLabelCache
+{
+public:
+    QGVLabelText text(const QString &text, const QFont &font, Qt::TextFormat format, Qt::Alignment alignment);
+
+    int size() const
+    {
+        return _texts.size();
+    }
+
+    // Items keep their copies, the layouts are released with the last one.
+    void clear()
+    {
+        _texts.clear();
+    }
+
+    // Number of texts laid out so far, not reset by clear()
+    quint64 parsed() const
+    {
+        return _parsed;
+    }
+
+private:
+    QHash<QString, QGVLabelText> _texts;
+    quint64 _parsed = 0;
+};
+
+/**
+ * @brief Node, edge, subgraph and graph label
+ *
+ * Draws a QGVLabelText from the label cache of the scene. Skips painting
+ * when the view is zoomed out below the label detail threshold of the scene.
+ */
+class QGVLabelItem : public QGraphicsItem
+{
+public:
+    QGVLabelItem(QGVScene *scene, QGraphicsItem *parent = nullptr);
+
+    void setText(const QString &text, Qt::TextFormat format = Qt::RichText, Qt::Alignment alignment = Qt::AlignCenter);
+
+    bool isEmpty() const
+    {
+        return _text.isEmpty();
+    }
+
+    // The fontcolor of the labeled object, black if invalid as in Graphviz
+    void setColor(const QColor &color);
+
+    // Positions the label centered on the point, in parent coordinates
+    void setCenter(const QPointF &center);
+
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
+
+private:
+    QGVScene *_scene;
+    QGVLabelText _text;
+    QFont _font;
+    QColor _color = Qt::black;
+};
+
+#endif // QGVLABELITEM_H
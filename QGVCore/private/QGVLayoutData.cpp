@@ -0,0 +1,360 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#include "QGVLayoutData.h"
+#include "QGVGvcPrivate.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+namespace
+{
+// Objects converted per task, enough to outweigh the scheduling overhead
+const int ParallelChunkSize = 256;
+
+void collect_subgraphs(Agraph_t *graph, const boxf &bb, QVector<QGVSubGraphLayout> &dest)
+{
+    for (auto sg = agfstsubg(graph); sg; sg = agnxtsubg(sg))
+    {
+        auto layout = QGVLayoutData::subGraphLayout(sg, bb);
+        layout.name = agnameof(sg);
+        dest.append(layout);
+        collect_subgraphs(sg, bb, dest);
+    }
+}
+}
+
+QGVLabelLayout QGVLayoutData::labelLayout(const textlabel_t *label, const boxf &bb)
+{
+    QGVLabelLayout result;
+
+    if (label)
+    {
+        result.valid = true;
+        result.text = label->text;
+        result.center = QGVCore::toPoint(label->pos, bb);
+        result.width = label->dimen.x;
+    }
+
+    return result;
+}
+
+QGVNodeLayout QGVLayoutData::nodeLayout(Agnode_t *node, const boxf &bb)
+{
+    QGVNodeLayout result;
+    result.width = ND_width(node)*DotDefaultDPI;
+    result.height = ND_height(node)*DotDefaultDPI;
+
+    //Node Position (center)
+    result.pos = QGVCore::centerToOrigin(QGVCore::toPoint(ND_coord(node), bb), result.width, result.height);
+
+    //Node path
+    result.path = QGVCore::toPath(ND_shape(node)->name, (polygon_t*)ND_shape_info(node), result.width, result.height);
+
+    return result;
+}
+
+QGVEdgeLayout QGVLayoutData::edgeLayout(Agedge_t *edge, const boxf &bb)
+{
+    QGVEdgeLayout result;
+
+    const splines* spl = ED_spl(edge);
+    result.path = QGVCore::toPath(spl, bb);
+
+    //Edge arrows, the tail one is on the first bezier, the head one on the last
+    if (spl && spl->size > 0)
+    {
+        const bezier &first = spl->list[0];
+        const bezier &last = spl->list[spl->size-1];
+
+        if(first.sflag && first.size > 0)
+        {
+            result.tailArrow = QGVCore::toArrow(QLineF(QGVCore::toPoint(first.list[0], bb), QGVCore::toPoint(first.sp, bb)));
+        }
+
+        if(last.eflag && last.size > 0)
+        {
+            result.headArrow = QGVCore::toArrow(QLineF(QGVCore::toPoint(last.list[last.size-1], bb), QGVCore::toPoint(last.ep, bb)));
+        }
+    }
+
+    textlabel_t *label = ED_label(edge);
+
+    if (!label)
+       label = ED_xlabel(edge);
+
+    result.label = labelLayout(label, bb);
+    result.headLabel = labelLayout(ED_head_label(edge), bb);
+    result.tailLabel = labelLayout(ED_tail_label(edge), bb);
+
+    return result;
+}
+
+QGVSubGraphLayout QGVLayoutData::subGraphLayout(Agraph_t *graph, const boxf &bb)
+{
+    QGVSubGraphLayout result;
+
+    //SubGraph box
+    boxf box = GD_bb(graph);
+    pointf p1 = box.UR;
+    pointf p2 = box.LL;
+    result.width = p1.x - p2.x;
+    result.height = p1.y - p2.y;
+    result.pos = QPointF(p2.x - bb.LL.x, bb.UR.y - p1.y);
+
+    if (auto xlabel = GD_label(graph))
+        result.label = xlabel->text;
+
+    return result;
+}
+
+QVector<QPair<Agedge_t *, QByteArray>> QGVLayoutData::keyedEdges(Agraph_t *graph, bool locked)
+{
+    QVector<QPair<Agedge_t *, QByteArray>> result;
+    QHash<Agnode_t *, int> parallel;
+
+    for (Agnode_t* node = agfstnode(graph); node != NULL; node = agnxtnode(graph, node))
+    {
+        const QByteArray tail = QGVCore::nameOf(node, locked) + '\x1f';
+        parallel.clear();
+
+        for (Agedge_t* edge = agfstout(graph, node); edge != NULL; edge = agnxtout(graph, edge))
+        {
+            QByteArray key = tail + QGVCore::nameOf(aghead(edge), locked) + '\x1f';
+
+            if (char *name = agnameof(edge))
+                key += name;
+            else
+                key += QByteArray::number(parallel[aghead(edge)]++);
+
+            result.append(qMakePair(edge, key));
+        }
+    }
+
+    return result;
+}
+
+void QGVLayoutData::parallelFor(int count, const std::function<void (int)> &convert)
+{
+    if (count <= ParallelChunkSize || QThreadPool::globalInstance()->maxThreadCount() < 2)
+    {
+        for (int i = 0; i < count; i++)
+            convert(i);
+        return;
+    }
+
+    QVector<int> chunks;
+    chunks.reserve(count / ParallelChunkSize + 1);
+
+    for (int begin = 0; begin < count; begin += ParallelChunkSize)
+        chunks.append(begin);
+
+    QtConcurrent::blockingMap(chunks, [count, &convert] (int begin)
+    {
+        const int end = qMin(count, begin + ParallelChunkSize);
+
+        for (int i = begin; i < end; i++)
+            convert(i);
+    });
+}
+
+QGVLayoutData QGVLayoutData::fromGraph(Agraph_t *graph)
+{
+    QGVLayoutData result;
+    const boxf bb = GD_bb(graph);
+
+    result.valid = true;
+    result.graphLabel = labelLayout(GD_label(graph), bb);
+
+    collect_subgraphs(graph, bb, result.subGraphs);
+
+    // Names and keys are read serially, the geometry is converted in parallel.
+    QVector<Agnode_t *> nodes;
+    QVector<QByteArray> names;
+    nodes.reserve(agnnodes(graph));
+    names.reserve(agnnodes(graph));
+
+    for (Agnode_t* node = agfstnode(graph); node != NULL; node = agnxtnode(graph, node))
+    {
+        nodes.append(node);
+        names.append(agnameof(node));
+    }
+
+    const auto edges = keyedEdges(graph);
+    result.nodes.resize(nodes.size());
+    result.edges.resize(edges.size());
+    QGVNodeLayout *nodeLayouts = result.nodes.data();
+    QGVEdgeLayout *edgeLayouts = result.edges.data();
+
+    parallelFor(nodes.size() + edges.size(), [&] (int i)
+    {
+        if (i < nodes.size())
+        {
+            nodeLayouts[i] = nodeLayout(nodes.at(i), bb);
+            nodeLayouts[i].name = names.at(i);
+        }
+        else
+        {
+            const int e = i - nodes.size();
+            edgeLayouts[e] = edgeLayout(edges.at(e).first, bb);
+            edgeLayouts[e].key = edges.at(e).second;
+        }
+    });
+
+    return result;
+}
+
+QByteArray QGVLayoutRequest::optionsKey() const
+{
+    QByteArray result;
+
+    for (const auto &option: options)
+        result += option.first + '=' + option.second + ';';
+
+    return result;
+}
+
+QGVLayoutRequest::Options QGVLayoutData::applyOptions(Agraph_t *graph, const QGVLayoutRequest::Options &options)
+{
+    QGVLayoutRequest::Options previous;
+
+    for (const auto &option: options)
+    {
+        Agsym_t *symbol = agattr(graph, AGRAPH, const_cast<char *>(option.first.constData()), NULL);
+        QByteArray value = symbol ? QByteArray(agxget(graph, symbol)) : QByteArray();
+        previous.append(qMakePair(option.first, value));
+        agsafeset(graph, const_cast<char *>(option.first.constData()), const_cast<char *>(option.second.constData()), const_cast<char *>(""));
+    }
+
+    return previous;
+}
+
+bool QGVLayoutData::optionsDeclared(Agraph_t *graph, const QGVLayoutRequest::Options &options)
+{
+    for (const auto &option: options)
+    {
+        if (!agattr(graph, AGRAPH, const_cast<char *>(option.first.constData()), NULL))
+            return false;
+    }
+
+    return true;
+}
+
+QGVLayoutData QGVLayoutData::compute(const QByteArray &dot, const QGVLayoutRequest &request)
+{
+    QMutexLocker locker(&QGVGvcPrivate::mutex());
+    QGVLayoutData result;
+
+    // Other layouts may have held the lock for a while.
+    if (request.isCancelled())
+        return result;
+
+    Agraph_t *graph = QGVCore::agmemread2(dot.constData(), dot.size());
+
+    if (!graph)
+    {
+        qWarning() << "Could not parse graph for layout" << agerrors() << QString::fromLocal8Bit(aglasterr());
+        return result;
+    }
+
+    applyOptions(graph, request.options);
+
+    GVC_t *context = QGVGvcPrivate::acquireContext();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (request.isCancelled())
+    {
+        // Skip the layout
+    }
+    else if (gvLayout(context, graph, request.engine.constData()) == 0)
+    {
+        const qint64 layoutTime = timer.nsecsElapsed();
+
+        if (!request.isCancelled())
+        {
+            result = fromGraph(graph);
+            result.layoutTime = layoutTime;
+            result.conversionTime = timer.nsecsElapsed() - layoutTime;
+        }
+
+        gvFreeLayout(context, graph);
+    }
+    else
+    {
+        qCritical()<<"Layout render error"<<request.engine<<agerrors()<<QString::fromLocal8Bit(aglasterr());
+    }
+
+    agclose(graph);
+    QGVGvcPrivate::releaseContext();
+    return result;
+}
+
+QDataStream &operator<<(QDataStream &out, const QGVLabelLayout &layout)
+{
+    return out << layout.valid << layout.text << layout.center << layout.width;
+}
+
+QDataStream &operator>>(QDataStream &in, QGVLabelLayout &layout)
+{
+    return in >> layout.valid >> layout.text >> layout.center >> layout.width;
+}
+
+QDataStream &operator<<(QDataStream &out, const QGVNodeLayout &layout)
+{
+    return out << layout.name << layout.pos << layout.width << layout.height << layout.path;
+}
+
+QDataStream &operator>>(QDataStream &in, QGVNodeLayout &layout)
+{
+    return in >> layout.name >> layout.pos >> layout.width >> layout.height >> layout.path;
+}
+
+QDataStream &operator<<(QDataStream &out, const QGVEdgeLayout &layout)
+{
+    return out << layout.key << layout.path << layout.headArrow << layout.tailArrow
+               << layout.label << layout.headLabel << layout.tailLabel;
+}
+
+QDataStream &operator>>(QDataStream &in, QGVEdgeLayout &layout)
+{
+    return in >> layout.key >> layout.path >> layout.headArrow >> layout.tailArrow
+              >> layout.label >> layout.headLabel >> layout.tailLabel;
+}
+
+QDataStream &operator<<(QDataStream &out, const QGVSubGraphLayout &layout)
+{
+    return out << layout.name << layout.pos << layout.width << layout.height << layout.label;
+}
+
+QDataStream &operator>>(QDataStream &in, QGVSubGraphLayout &layout)
+{
+    return in >> layout.name >> layout.pos >> layout.width >> layout.height >> layout.label;
+}
+
+QDataStream &operator<<(QDataStream &out, const QGVLayoutData &layout)
+{
+    return out << layout.valid << layout.graphLabel << layout.nodes << layout.edges << layout.subGraphs;
+}
+
+QDataStream &operator>>(QDataStream &in, QGVLayoutData &layout)
+{
+    return in >> layout.valid >> layout.graphLabel >> layout.nodes >> layout.edges >> layout.subGraphs;
+}
@@ -0,0 +1,163 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#ifndef QGVLAYOUTDATA_H
+#define QGVLAYOUTDATA_H
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QHash>
+#include <QPainterPath>
+#include <QPair>
+#include <QPolygonF>
+#include <QString>
+#include <QVector>
+#include <functional>
+
+#include "QGVCore.h"
+#include "qgv_export.h"
+
+struct QGVLabelLayout
+{
+    bool valid = false;
+    QString text;
+    QPointF center;
+    qreal width = 0.0;
+};
+
+struct QGVNodeLayout
+{
+    QByteArray name;
+    QPointF pos;        // top left corner in scene coordinates
+    qreal width = 0.0;
+    qreal height = 0.0;
+    QPainterPath path;  // in item coordinates
+};
+
+struct QGVEdgeLayout
+{
+    QByteArray key;     // see QGVLayoutData::keyedEdges()
+    QPainterPath path;
+    QPolygonF headArrow;
+    QPolygonF tailArrow;
+    QGVLabelLayout label;
+    QGVLabelLayout headLabel;
+    QGVLabelLayout tailLabel;
+};
+
+struct QGVSubGraphLayout
+{
+    QByteArray name;
+    QPointF pos;
+    qreal width = 0.0;
+    qreal height = 0.0;
+    QString label;
+};
+
+/**
+ * @brief Layout engine and graph attributes to lay a graph out with
+ */
+struct QGVLayoutRequest
+{
+    typedef QVector<QPair<QByteArray, QByteArray>> Options;
+
+    QByteArray engine = "dot";
+    Options options;
+    // Polled by compute() between its phases, may be called from the worker
+    // thread. A running layout engine cannot be interrupted.
+    std::function<bool ()> cancelled;
+
+    // Canonical form of the options, part of the layout cache key.
+    QByteArray optionsKey() const;
+
+    bool isCancelled() const
+    {
+        return cancelled && cancelled();
+    }
+};
+
+/**
+ * @brief Graphviz layout results converted to scene geometry
+ *
+ * Holds everything the QGV items need to position themselves, detached from
+ * the cgraph objects the layout was computed on. Objects are identified by
+ * name so a layout computed on a copy of the scene graph can be applied to
+ * the items of the original one.
+ */
+struct QGVCORE_PRIVATE_EXPORT QGVLayoutData
+{
+    bool valid = false;
+    QGVLabelLayout graphLabel;
+    QVector<QGVNodeLayout> nodes;
+    QVector<QGVEdgeLayout> edges;
+    QVector<QGVSubGraphLayout> subGraphs;
+
+    // Set by compute(), in nanoseconds. Not serialized.
+    qint64 layoutTime = 0;
+    qint64 conversionTime = 0;
+
+    // Conversion of a single laid out object. Only read the layout records.
+    // bb is the bounding box of the root graph, its top left corner is mapped
+    // to the scene origin.
+    static QGVLabelLayout labelLayout(const textlabel_t *label, const boxf &bb);
+    static QGVNodeLayout nodeLayout(Agnode_t *node, const boxf &bb);
+    static QGVEdgeLayout edgeLayout(Agedge_t *edge, const boxf &bb);
+    static QGVSubGraphLayout subGraphLayout(Agraph_t *graph, const boxf &bb);
+
+    // Calls convert(i) for i in [0, count), spread over the global thread
+    // pool for large counts. For the conversion functions above, which only
+    // read the graph and must not be mixed with cgraph calls like agnameof()
+    // that use static buffers.
+    static void parallelFor(int count, const std::function<void (int)> &convert);
+
+    // Edges of the graph with a key that is stable across agwrite/agread:
+    // tail and head name plus either the edge key or the index among the
+    // anonymous parallel edges. locked tells whether the caller holds the
+    // global Graphviz lock, see QGVCore::nameOf().
+    static QVector<QPair<Agedge_t *, QByteArray>> keyedEdges(Agraph_t *graph, bool locked = true);
+
+    // Collects the layout of all objects of an already laid out graph.
+    static QGVLayoutData fromGraph(Agraph_t *graph);
+
+    // Sets the graph attributes of the options, returns their previous values
+    // so they can be restored. Only restores options that were declared
+    // before, see optionsDeclared().
+    static QGVLayoutRequest::Options applyOptions(Agraph_t *graph, const QGVLayoutRequest::Options &options);
+
+    // Whether all options are declared graph attributes. cgraph can not
+    // undeclare an attribute again, a restored undeclared option stays
+    // declared as "", which differs from the default for e.g. splines.
+    static bool optionsDeclared(Agraph_t *graph, const QGVLayoutRequest::Options &options);
+
+    // Parses the DOT text into a private graph, lays it out as requested and
+    // returns the result. Safe to call from a worker thread. Returns an
+    // invalid layout if the request got cancelled.
+    static QGVLayoutData compute(const QByteArray &dot, const QGVLayoutRequest &request);
+};
+
+QDataStream &operator<<(QDataStream &out, const QGVLabelLayout &layout);
+QDataStream &operator>>(QDataStream &in, QGVLabelLayout &layout);
+QDataStream &operator<<(QDataStream &out, const QGVNodeLayout &layout);
+QDataStream &operator>>(QDataStream &in, QGVNodeLayout &layout);
+QDataStream &operator<<(QDataStream &out, const QGVEdgeLayout &layout);
+QDataStream &operator>>(QDataStream &in, QGVEdgeLayout &layout);
+QDataStream &operator<<(QDataStream &out, const QGVSubGraphLayout &layout);
+QDataStream &operator>>(QDataStream &in, QGVSubGraphLayout &layout);
+QDataStream &operator<<(QDataStream &out, const QGVLayoutData &layout);
+QDataStream &operator>>(QDataStream &in, QGVLayoutData &layout);
+
+#endif // QGVLAYOUTDATA_H
@@ -10,6 +10,12 @@ void QGVNodePrivate::setNode(Agnode_t *node)
     _node = node;
 }
 
+void QGVNodePrivate::setNode(Agnode_t *node, Agraph_t *parent)
+{
+    _node = node;
+    _parent = parent;
+}
+
 Agnode_t* QGVNodePrivate::node() const
 {
     return _node;
@@ -9,6 +9,7 @@ public:
     QGVNodePrivate(Agnode_t *node, Agraph_t *parent);
 
     void setNode(Agnode_t *node);
+    void setNode(Agnode_t *node, Agraph_t *parent);
     Agnode_t* node() const;
     
     Agraph_t* graph() const;
@@ -0,0 +1,45 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#ifndef QGVPRIVATEPOOLS_H
+#define QGVPRIVATEPOOLS_H
+
+#include "QGVEdgePrivate.h"
+#include "QGVGraphPrivate.h"
+#include "QGVNodePrivate.h"
+#include "QGVSlabPool.h"
+
+/**
+ * @brief Allocators of the private objects of the items of a scene
+ *
+ * Owned by QGVScene and cleared together with its items.
+ */
+struct QGVPrivatePools
+{
+    QGVSlabPool<QGVNodePrivate> nodes;
+    QGVSlabPool<QGVEdgePrivate> edges;
+    QGVSlabPool<QGVGraphPrivate> graphs;
+
+    void clear()
+    {
+        nodes.clear();
+        edges.clear();
+        graphs.clear();
+    }
+};
+
+#endif // QGVPRIVATEPOOLS_H
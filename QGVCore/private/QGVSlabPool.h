@@ -0,0 +1,146 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#ifndef QGVSLABPOOL_H
+#define QGVSLABPOOL_H
+
+#include <QVector>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @brief Fixed size slab allocator for the private objects of the items
+ *
+ * Objects are carved out of slabs of SlabSize slots. Destroyed objects are
+ * put on a free list and reused. clear() drops all objects at once, which is
+ * why T has to be trivially destructible, and keeps the first slab around for
+ * the next graph.
+ */
+template <typename T, int SlabSize = 1024>
+class QGVSlabPool
+{
+    static_assert(std::is_trivially_destructible<T>::value, "clear() does not run destructors");
+
+public:
+    struct Stats
+    {
+        quint64 live = 0;
+        quint64 slabs = 0;
+        quint64 allocations = 0;
+        quint64 reused = 0;
+        quint64 slabAllocations = 0;
+    };
+
+    QGVSlabPool() = default;
+    QGVSlabPool(const QGVSlabPool &) = delete;
+    QGVSlabPool &operator=(const QGVSlabPool &) = delete;
+
+    ~QGVSlabPool()
+    {
+        for (auto slab: _slabs)
+            delete[] slab;
+    }
+
+    template <typename... Args>
+    T *create(Args &&... args)
+    {
+        Slot *slot = _free;
+
+        if (slot)
+        {
+            _free = slot->next;
+            ++_stats.reused;
+        }
+        else
+        {
+            if (_slabs.isEmpty() || _used == SlabSize)
+            {
+                // After clear() the first slab is still there
+                if (_current + 1 < _slabs.size())
+                {
+                    ++_current;
+                }
+                else
+                {
+                    _slabs.append(new Slot[SlabSize]);
+                    _current = _slabs.size() - 1;
+                    ++_stats.slabAllocations;
+                }
+                _used = 0;
+            }
+
+            slot = &_slabs[_current][_used++];
+        }
+
+        ++_stats.live;
+        ++_stats.allocations;
+        return new (&slot->storage) T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T *object)
+    {
+        if (!object)
+            return;
+
+        object->~T();
+        Slot *slot = reinterpret_cast<Slot *>(object);
+        slot->next = _free;
+        _free = slot;
+        --_stats.live;
+    }
+
+    // Releases all objects, frees all slabs but the first one.
+    void clear()
+    {
+        for (int i = 1; i < _slabs.size(); i++)
+            delete[] _slabs[i];
+
+        _slabs.resize(qMin(_slabs.size(), 1));
+        _current = 0;
+        _used = _slabs.isEmpty() ? SlabSize : 0;
+        _free = nullptr;
+        _stats.live = 0;
+    }
+
+    Stats stats() const
+    {
+        Stats result = _stats;
+        result.slabs = _slabs.size();
+        return result;
+    }
+
+private:
+    union Slot
+    {
+        Slot *next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+public:
+    static const quint64 SlabBytes = quint64(SlabSize) * sizeof(Slot);
+
+private:
+
+    QVector<Slot *> _slabs;
+    int _current = 0;
+    int _used = SlabSize;
+    Slot *_free = nullptr;
+    Stats _stats;
+};
+
+#endif // QGVSLABPOOL_H
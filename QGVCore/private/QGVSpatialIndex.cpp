@@ -0,0 +1,126 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#include "QGVSpatialIndex.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// Sort-tile-recursive order: vertical slices sorted by x, each sorted by y,
+// so consecutive runs of capacity entries are spatially close.
+template <typename T, typename Center>
+void str_sort(QVector<T> &entries, int capacity, Center center)
+{
+    const int count = entries.size();
+    const int leaves = (count + capacity - 1) / capacity;
+    const int slices = qMax(1, int(std::ceil(std::sqrt(double(leaves)))));
+    const int sliceSize = slices * capacity;
+
+    std::sort(entries.begin(), entries.end(), [&center] (const T &a, const T &b)
+    {
+        return center(a).x() < center(b).x();
+    });
+
+    for (int begin = 0; begin < count; begin += sliceSize)
+    {
+        const int end = qMin(count, begin + sliceSize);
+        std::sort(entries.begin() + begin, entries.begin() + end, [&center] (const T &a, const T &b)
+        {
+            return center(a).y() < center(b).y();
+        });
+    }
+}
+}
+
+void QGVSpatialIndex::build(const QVector<QRectF> &rects)
+{
+    clear();
+
+    if (rects.isEmpty())
+        return;
+
+    _rects = rects;
+    _ids.resize(rects.size());
+
+    for (int i = 0; i < _ids.size(); i++)
+    {
+        _ids[i] = i;
+
+        // QRectF::intersects() is false for rectangles without area, e.g.
+        // the bounds of a straight horizontal edge.
+        QRectF &rect = _rects[i];
+        if (rect.width() <= 0.0 || rect.height() <= 0.0)
+            rect.adjust(-0.5, -0.5, 0.5, 0.5);
+    }
+
+    str_sort(_ids, Capacity, [this] (int id) { return _rects[id].center(); });
+
+    QVector<Node> level;
+    level.reserve((_ids.size() + Capacity - 1) / Capacity);
+
+    for (int begin = 0; begin < _ids.size(); begin += Capacity)
+    {
+        const int end = qMin(_ids.size(), begin + Capacity);
+        QRectF bounds = _rects[_ids[begin]];
+
+        for (int i = begin + 1; i < end; i++)
+            bounds |= _rects[_ids[i]];
+
+        level.append({ bounds, begin, end });
+    }
+
+    // The children of a node are referenced by range, order each level
+    // before building its parents.
+    while (level.size() > 1)
+    {
+        str_sort(level, Capacity, [] (const Node &node) { return node.bounds.center(); });
+
+        QVector<Node> parents;
+        parents.reserve((level.size() + Capacity - 1) / Capacity);
+
+        for (int begin = 0; begin < level.size(); begin += Capacity)
+        {
+            const int end = qMin(level.size(), begin + Capacity);
+            QRectF bounds = level[begin].bounds;
+
+            for (int i = begin + 1; i < end; i++)
+                bounds |= level[i].bounds;
+
+            parents.append({ bounds, begin, end });
+        }
+
+        _levels.append(level);
+        level = parents;
+    }
+
+    _levels.append(level);
+}
+
+void QGVSpatialIndex::clear()
+{
+    _rects.clear();
+    _ids.clear();
+    _levels.clear();
+}
+
+QVector<int> QGVSpatialIndex::query(const QRectF &rect) const
+{
+    QVector<int> result;
+    query(rect, [&result] (int id) { result.append(id); });
+    return result;
+}
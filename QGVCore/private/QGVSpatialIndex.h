@@ -0,0 +1,105 @@
+/***************************************************************
+QGVCore
+Copyright (c) 2014, Bergont Nicolas, All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+***************************************************************/
+#ifndef QGVSPATIALINDEX_H
+#define QGVSPATIALINDEX_H
+
+#include <QPair>
+#include <QRectF>
+#include <QVarLengthArray>
+#include <QVector>
+
+/**
+ * @brief Static R-tree over a set of rectangles
+ *
+ * Bulk loaded with the sort-tile-recursive algorithm, the tree is rebuilt
+ * rather than updated. Items are identified by their index in the vector
+ * passed to build().
+ */
+class QGVSpatialIndex
+{
+public:
+    void build(const QVector<QRectF> &rects);
+    void clear();
+
+    bool isEmpty() const
+    {
+        return _levels.isEmpty();
+    }
+
+    QRectF bounds() const
+    {
+        return isEmpty() ? QRectF() : _levels.last().first().bounds;
+    }
+
+    // Calls visit(int id) for every item whose rectangle intersects rect,
+    // rect needs a non-zero size.
+    template <typename Visit>
+    void query(const QRectF &rect, Visit visit) const;
+
+    QVector<int> query(const QRectF &rect) const;
+
+private:
+    struct Node
+    {
+        QRectF bounds;
+        int begin;  // children in the level below, items for leaves
+        int end;
+    };
+
+    static const int Capacity = 16;
+
+    QVector<QRectF> _rects;
+    QVector<int> _ids;
+    QVector<QVector<Node>> _levels;  // leaves first
+};
+
+template <typename Visit>
+void QGVSpatialIndex::query(const QRectF &rect, Visit visit) const
+{
+    if (isEmpty())
+        return;
+
+    // Pairs of level and node index
+    QVarLengthArray<QPair<int, int>, 64> stack;
+    stack.append(qMakePair(_levels.size() - 1, 0));
+
+    while (!stack.isEmpty())
+    {
+        const auto top = stack.takeLast();
+        const Node &node = _levels[top.first][top.second];
+
+        if (!node.bounds.intersects(rect))
+            continue;
+
+        if (top.first == 0)
+        {
+            for (int i = node.begin; i < node.end; i++)
+            {
+                if (_rects[_ids[i]].intersects(rect))
+                    visit(_ids[i]);
+            }
+        }
+        else
+        {
+            for (int i = node.begin; i < node.end; i++)
+                stack.append(qMakePair(top.first - 1, i));
+        }
+    }
+}
+
+#endif // QGVSPATIALINDEX_H
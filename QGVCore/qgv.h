@@ -1,6 +1,9 @@
 #ifndef __QGV_H_
 #define __QGV_H_
 
+#include "QGVAttribute.h"
+#include "QGVLayoutCache.h"
+#include "QGVLayoutService.h"
 #include "QGVScene.h"
 #include "QGVNode.h"
 #include "QGVEdge.h"
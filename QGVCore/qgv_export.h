@@ -9,4 +9,11 @@
 	#define QGVCORE_EXPORT Q_DECL_IMPORT
 #endif
 
+// Private classes the benchmarks use directly
+#ifdef QGV_BUILD_BENCH
+	#define QGVCORE_PRIVATE_EXPORT QGVCORE_EXPORT
+#else
+	#define QGVCORE_PRIVATE_EXPORT
+#endif
+
 #endif // QGV_EXPORT_H
@@ -155,13 +155,5 @@ void MainWindow::loadDotFile()
     if (filename.isEmpty())
         return;
 
-    QFile inFile(filename);
-
-    if (!inFile.open(QIODevice::ReadOnly))
-        return;
-
-    auto data = QString::fromLocal8Bit(inFile.readAll());
-
-    _scene->clearGraphItems();
-    _scene->loadLayout(data);
+    _scene->loadLayoutFromFile(filename);
 }
\ No newline at end of file